@@ -0,0 +1,10 @@
+#include "Build.h"
+
+#include <iomanip>
+#include <iostream>
+
+void BuildContext::Progress(const std::string& text) {
+  std::lock_guard<std::mutex> locker(mutex);
+  const auto percentage = ++current * 100 / total;
+  std::cout << "[ " << std::setfill(' ') << std::setw(3) << percentage << "% ] " << text << std::endl;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cab/TaskGraph.h"
+
+#include "BuildLog.h"
+#include "Metrics.h"
+#include "ProcessManager.h"
+#include "Project.h"
+#include "SourceAnalyzer.h"
+#include "Utils.h"
+
+// What the tasks of one build share. `mutex` guards the progress counts,
+// the metrics and the console.
+struct BuildContext {
+  BuildContext(
+    const std::map<std::string, std::string>& args,
+    const Project& project,
+    cab::TaskGraph& graph,
+    ProcessManager& processes,
+    BuildLog& log,
+    BuildMetrics& metrics,
+    const Stopwatch& watch,
+    std::vector<SourceFile>& files,
+    const std::vector<size_t>& owners,
+    std::vector<Linker>& linkers,
+    bool verbose)
+    : args(args),
+      project(project),
+      graph(graph),
+      processes(processes),
+      log(log),
+      metrics(metrics),
+      watch(watch),
+      files(files),
+      owners(owners),
+      linkers(linkers),
+      verbose(verbose) {
+  }
+
+  const std::map<std::string, std::string>& args;
+  const Project& project;
+  cab::TaskGraph& graph;
+  ProcessManager& processes;
+  BuildLog& log;
+  BuildMetrics& metrics;
+  const Stopwatch& watch;
+  // analyzed sources, the target each belongs to and the linker of each
+  // target, raised by its sources and by those it links against
+  std::vector<SourceFile>& files;
+  const std::vector<size_t>& owners;
+  std::vector<Linker>& linkers;
+  const bool verbose;
+
+  std::mutex mutex;
+  // compiles and links not ruled out by analysis yet, and those started
+  size_t total = 0;
+  size_t current = 0;
+
+  // Prints `text` as the next step with how far the build is; takes the lock.
+  void Progress(const std::string& text);
+};
@@ -0,0 +1,109 @@
+#include "BuildLog.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static constexpr auto kHeader = "# sb build log v1";
+
+auto BuildLog::Load() -> bool {
+  std::ifstream stream(path_);
+  if (!stream) {
+    return false;
+  }
+  std::string line;
+  if (!std::getline(stream, line) || line != kHeader) {
+    return false;
+  }
+  std::lock_guard<std::mutex> locker(mutex_);
+  while (std::getline(stream, line)) {
+    std::istringstream fields(line);
+    std::string output;
+    if (!std::getline(fields, output, '\t') || output.empty()) {
+      continue;
+    }
+    BuildRecord record;
+    for (std::string field; std::getline(fields, field, '\t');) {
+      const auto pos = field.find('=');
+      if (pos == std::string::npos) {
+        continue;
+      }
+      const auto& key = field.substr(0, pos);
+      const auto& value = field.substr(pos + 1);
+      if (key == "wall") {
+        record.wall = std::strtod(value.c_str(), nullptr);
+      } else if (key == "user") {
+        record.user = std::strtod(value.c_str(), nullptr);
+      } else if (key == "sys") {
+        record.system = std::strtod(value.c_str(), nullptr);
+      } else if (key == "rss") {
+        record.max_rss = std::strtol(value.c_str(), nullptr, 10);
+      } else if (key == "input") {
+        record.input = std::strtoull(value.c_str(), nullptr, 16);
+      } else if (key == "content") {
+        record.content = std::strtoull(value.c_str(), nullptr, 16);
+      } else if (key == "byproduct") {
+        record.byproducts.push_back(value);
+      }
+    }
+    records_.insert_or_assign(std::move(output), record);
+  }
+  return true;
+}
+
+auto BuildLog::Save() const -> bool {
+  const auto& temp = path_ + ".tmp";
+  {
+    std::ofstream stream(temp, std::ios::trunc);
+    if (!stream) {
+      return false;
+    }
+    stream << kHeader << '\n';
+    std::lock_guard<std::mutex> locker(mutex_);
+    for (const auto& [output, record] : records_) {
+      stream
+        << output
+        << "\twall=" << record.wall
+        << "\tuser=" << record.user
+        << "\tsys=" << record.system
+        << "\trss=" << record.max_rss
+        << std::hex
+        << "\tinput=" << record.input
+        << "\tcontent=" << record.content
+        << std::dec;
+      for (const auto& byproduct : record.byproducts) {
+        stream << "\tbyproduct=" << byproduct;
+      }
+      stream << '\n';
+    }
+    if (!stream.flush()) {
+      return false;
+    }
+  }
+  return std::rename(temp.c_str(), path_.c_str()) == 0;
+}
+
+auto BuildLog::Find(const std::string& output) const -> std::optional<BuildRecord> {
+  std::lock_guard<std::mutex> locker(mutex_);
+  const auto& iter = records_.find(output);
+  if (iter == records_.end()) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+void BuildLog::Update(const std::string& output, const BuildRecord& record) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  records_.insert_or_assign(output, record);
+}
+
+void BuildLog::Erase(const std::string& output) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  records_.erase(output);
+}
+
+auto BuildLog::Records() const -> std::map<std::string, BuildRecord> {
+  std::lock_guard<std::mutex> locker(mutex_);
+  return records_;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Per-output figures from the last successful run; times in seconds, rss in
+// KiB for the largest single process of the step. `input` and `content` are
+// hashes of the preprocessed source, or for links of the object contents, and
+// of the produced file, or zero when unknown. `byproducts` lists the other
+// files the step wrote, so that they can be cleaned without analyzing sources.
+struct BuildRecord {
+  double wall = 0;
+  double user = 0;
+  double system = 0;
+  long max_rss = 0;
+  uint64_t input = 0;
+  uint64_t content = 0;
+  std::vector<std::string> byproducts;
+};
+
+class BuildLog {
+ public:
+  explicit BuildLog(std::string path)
+    : path_(std::move(path)) {
+  }
+
+  BuildLog(const BuildLog&) = delete;
+  BuildLog(BuildLog&&) = delete;
+  auto operator=(const BuildLog&) -> BuildLog& = delete;
+  auto operator=(BuildLog&&) -> BuildLog& = delete;
+
+  auto Load() -> bool;
+  [[nodiscard]] auto Save() const -> bool;
+
+  [[nodiscard]] auto Find(const std::string& output) const -> std::optional<BuildRecord>;
+  void Update(const std::string& output, const BuildRecord& record);
+  void Erase(const std::string& output);
+  [[nodiscard]] auto Records() const -> std::map<std::string, BuildRecord>;
+
+ private:
+  std::string path_;
+  std::map<std::string, BuildRecord> records_;
+  mutable std::mutex mutex_;
+};
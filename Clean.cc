@@ -0,0 +1,141 @@
+#include "Clean.h"
+#include "Modules.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+
+#include "cab/TaskGraph.h"
+
+static auto Normal(const std::string& path) -> std::string {
+  return std::filesystem::path(path).lexically_normal().string();
+}
+
+auto CleanCandidates(
+  const std::map<std::string, std::string>& args,
+  const Project& project,
+  const std::vector<std::unique_ptr<SourceAnalyzer>>& analyzers,
+  const std::vector<std::string>& sources,
+  const std::vector<size_t>& owners,
+  BuildLog& log,
+  bool gc) -> std::vector<std::string> {
+  const auto& workdir = args.at("workdir");
+  const auto& test_pattern = args.at("test");
+  const auto testing = !test_pattern.empty();
+  // names any build of these sources may use, which gc keeps, and the
+  // outputs the current options make, which clean removes even unrecorded
+  std::set<std::string> owned;
+  std::set<std::string> produced;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    for (const auto& artifact : analyzers[owners[i]]->Artifacts(sources[i])) {
+      owned.insert(Normal(artifact));
+    }
+    for (const auto& output : analyzers[owners[i]]->Outputs(sources[i])) {
+      produced.insert(Normal(output));
+    }
+  }
+  for (const auto& target : project.targets) {
+    for (const auto& suffix : {"", ".rsp", ".dwp", ".dwp.rsp"}) {
+      owned.insert(Normal(target.output + suffix));
+    }
+    owned.insert(Normal(ModuleMapperPath(target.args.at("workdir"))));
+    if (!testing) {
+      produced.insert(Normal(target.output));
+    }
+    if (!testing && !args.at("dwp").empty() && target.type != TargetType::Static) {
+      produced.insert(Normal(target.output + ".dwp"));
+    }
+    if (args.at("modules") == "1") {
+      produced.insert(Normal(ModuleMapperPath(target.args.at("workdir"))));
+    }
+  }
+  owned.insert(Normal(TestArchivePath(workdir)));
+  owned.insert(Normal(TestArchivePath(workdir) + ".rsp"));
+  if (testing) {
+    produced.insert(Normal(TestArchivePath(workdir)));
+  }
+  for (const auto& source : sources) {
+    if (IsTestSource(source, testing ? test_pattern : kDefaultTestPattern)) {
+      const auto& binary = TestBinaryPath(workdir, source);
+      owned.insert(Normal(binary));
+      owned.insert(Normal(TestLogPath(binary)));
+      if (testing) {
+        produced.insert(Normal(binary));
+        produced.insert(Normal(TestLogPath(binary)));
+      }
+    }
+  }
+  // byproducts like module interfaces are not derivable from source names
+  const auto& records = log.Records();
+  for (const auto& [output, record] : records) {
+    if (owned.count(Normal(output)) > 0) {
+      for (const auto& byproduct : record.byproducts) {
+        owned.insert(Normal(byproduct));
+      }
+    }
+  }
+  std::set<std::string> candidates;
+  if (!gc) {
+    // recorded outputs of this build with their byproducts
+    candidates = produced;
+    for (const auto& [output, record] : records) {
+      if (owned.count(Normal(output)) > 0) {
+        candidates.insert(Normal(output));
+        for (const auto& byproduct : record.byproducts) {
+          candidates.insert(Normal(byproduct));
+        }
+      }
+    }
+  } else {
+    // only objects an earlier build recorded, never files sb did not write
+    // nor what other targets in the same workdir link
+    for (const auto& [output, record] : records) {
+      if (owned.count(Normal(output)) == 0 && std::filesystem::path(output).extension() == ".o") {
+        candidates.insert(Normal(output));
+        for (const auto& byproduct : record.byproducts) {
+          candidates.insert(Normal(byproduct));
+        }
+      }
+    }
+    for (const auto& path : owned) {
+      candidates.erase(path);
+    }
+    for (const auto& [output, record] : records) {
+      if (candidates.count(Normal(output)) > 0) {
+        log.Erase(output);
+      }
+    }
+  }
+  return {candidates.begin(), candidates.end()};
+}
+
+auto RemoveFiles(cab::Executor& executor, const std::vector<std::string>& paths, size_t jobs, bool verbose) -> size_t {
+  std::atomic_size_t removed = 0;
+  std::mutex mutex;
+  cab::TaskGraph graph(executor);
+  const auto chunk = std::max<size_t>(1, (paths.size() + jobs - 1) / jobs);
+  for (size_t begin = 0; begin < paths.size(); begin += chunk) {
+    graph.Add([&, begin]() {
+      const auto end = std::min(paths.size(), begin + chunk);
+      for (size_t i = begin; i < end; ++i) {
+        std::error_code err;
+        if (!std::filesystem::remove(paths[i], err)) {
+          continue;
+        }
+        ++removed;
+        if (verbose) {
+          std::lock_guard<std::mutex> locker(mutex);
+          std::cout << "(I) removed " << paths[i] << std::endl;
+        }
+      }
+      return true;
+    });
+  }
+  graph.Run();
+  graph.Wait();
+  return removed;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cab/Executor.h"
+
+#include "BuildLog.h"
+#include "Project.h"
+#include "SourceAnalyzer.h"
+
+// Files to remove for clean: the outputs the current options make, even
+// unrecorded, and every recorded output of `sources` with its byproducts.
+// With `gc`, only recorded objects no source owns any more, which are also
+// dropped from `log`. User files in the workdir are never listed.
+auto CleanCandidates(
+  const std::map<std::string, std::string>& args,
+  const Project& project,
+  const std::vector<std::unique_ptr<SourceAnalyzer>>& analyzers,
+  const std::vector<std::string>& sources,
+  const std::vector<size_t>& owners,
+  BuildLog& log,
+  bool gc) -> std::vector<std::string>;
+
+// Unlinks `paths` in parallel chunks, returns the number of files that existed.
+auto RemoveFiles(cab::Executor& executor, const std::vector<std::string>& paths, size_t jobs, bool verbose) -> size_t;
@@ -0,0 +1,96 @@
+#include "Impact.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <numeric>
+#include <queue>
+
+static auto NormalizePath(const std::string& path) -> std::string {
+  return std::filesystem::path(path).lexically_normal().string();
+}
+
+void ImpactIndex::Add(const SourceFile& file) {
+  const auto& source = NormalizePath(file.source);
+  sources_.insert(source);
+  dependents_[source].insert(file.output);
+  for (const auto& dependency : file.dependencies) {
+    dependents_[NormalizePath(dependency)].insert(file.output);
+  }
+}
+
+auto ImpactIndex::Query(const std::string& path) const -> ImpactReport {
+  const auto& key = NormalizePath(path);
+  const auto& iter = dependents_.find(key);
+  if (iter == dependents_.end()) {
+    return {key, {}, {}, 0, 0, 0};
+  }
+  return Estimate(key, iter->second);
+}
+
+auto ImpactIndex::Rank(size_t n) const -> std::vector<ImpactReport> {
+  std::vector<ImpactReport> reports;
+  for (const auto& [path, outputs] : dependents_) {
+    if (sources_.count(path) == 0) {
+      reports.push_back(Estimate(path, outputs));
+    }
+  }
+  std::sort(reports.begin(), reports.end(), [](const auto& a, const auto& b) {
+    if (a.wall != b.wall) {
+      return a.wall > b.wall;
+    }
+    return a.outputs.size() > b.outputs.size();
+  });
+  if (reports.size() > n) {
+    reports.resize(n);
+  }
+  return reports;
+}
+
+auto ImpactIndex::Estimate(const std::string& path, const std::set<std::string>& outputs) const -> ImpactReport {
+  ImpactReport report{path, {outputs.begin(), outputs.end()}, {}, 0, 0, 0};
+  double known = 0;
+  for (const auto& output : report.outputs) {
+    const auto& record = log_.Find(output);
+    if (record) {
+      known += record->wall;
+      report.costs.push_back(record->wall);
+    } else {
+      ++report.unknown;
+      report.costs.push_back(-1);
+    }
+  }
+  const auto known_count = report.outputs.size() - report.unknown;
+  const auto fallback = known_count > 0 ? known / known_count : 0;
+  std::vector<double> costs(report.costs);
+  for (auto& cost : costs) {
+    if (cost < 0) {
+      cost = fallback;
+    }
+  }
+  report.cpu = std::accumulate(costs.begin(), costs.end(), 0.0);
+  report.wall = EstimateWallTime(std::move(costs), jobs_);
+  return report;
+}
+
+auto EstimateWallTime(std::vector<double> costs, size_t jobs) -> double {
+  if (costs.empty()) {
+    return 0;
+  }
+  jobs = std::max<size_t>(1, std::min(jobs, costs.size()));
+  std::sort(costs.begin(), costs.end(), std::greater<>());
+  std::priority_queue<double, std::vector<double>, std::greater<>> workers;
+  for (size_t i = 0; i < jobs; ++i) {
+    workers.push(0);
+  }
+  for (const auto cost : costs) {
+    const auto load = workers.top();
+    workers.pop();
+    workers.push(load + cost);
+  }
+  double wall = 0;
+  for (; !workers.empty(); workers.pop()) {
+    wall = std::max(wall, workers.top());
+  }
+  return wall;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BuildLog.h"
+#include "SourceAnalyzer.h"
+
+struct ImpactReport {
+  std::string path;
+  std::vector<std::string> outputs;
+  std::vector<double> costs;
+  size_t unknown = 0;
+  double cpu = 0;
+  double wall = 0;
+};
+
+class ImpactIndex {
+ public:
+  ImpactIndex(const BuildLog& log, size_t jobs)
+    : log_(log), jobs_(jobs) {
+  }
+
+  void Add(const SourceFile& file);
+
+  [[nodiscard]] auto Query(const std::string& path) const -> ImpactReport;
+  [[nodiscard]] auto Rank(size_t n) const -> std::vector<ImpactReport>;
+
+ private:
+  [[nodiscard]] auto Estimate(const std::string& path, const std::set<std::string>& outputs) const -> ImpactReport;
+
+ private:
+  const BuildLog& log_;
+  size_t jobs_;
+  std::map<std::string, std::set<std::string>> dependents_;
+  std::set<std::string> sources_;
+};
+
+auto EstimateWallTime(std::vector<double> costs, size_t jobs) -> double;
@@ -0,0 +1,122 @@
+#include "JobTuner.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+JobTuner::JobTuner(size_t start, size_t max)
+  : limit_(std::clamp<size_t>(start, 1, std::max<size_t>(1, max))),
+    max_(std::max<size_t>(1, max)),
+    step_(std::max<size_t>(1, max_ / 8)),
+    direction_(limit_ < max_ ? 1 : -1),
+    best_(limit_),
+    warmup_(limit_) {
+}
+
+auto JobTuner::Record(double now, double work) -> bool {
+  if (settled_) {
+    return false;
+  }
+  if (warmup_ > 0) {
+    --warmup_;
+    start_ = now;
+    return false;
+  }
+  work_ += work;
+  if (++count_ < std::max<size_t>(4, 2 * limit_)) {
+    return false;
+  }
+  const auto rate = work_ / std::max(now - start_, 1e-3);
+  count_ = 0;
+  work_ = 0;
+  start_ = now;
+  std::ostringstream why;
+  why << std::fixed << std::setprecision(2) << rate << " compile-seconds/s at " << limit_ << " job(s)";
+  // noise should not count as progress
+  const auto improved = best_rate_ < 0 || rate > best_rate_ * 1.05;
+  if (improved) {
+    if (best_rate_ >= 0) {
+      why << ", up from " << best_rate_ << " at " << best_;
+    }
+    best_ = limit_;
+    best_rate_ = rate;
+  } else {
+    why << ", no better than " << best_rate_ << " at " << best_;
+  }
+  const auto candidate = [&]() {
+    return static_cast<long>(best_) + direction_ * static_cast<long>(step_);
+  };
+  const auto fits = [&](long next) {
+    return next >= 1 && next <= static_cast<long>(max_);
+  };
+  auto next = candidate();
+  if (!improved || !fits(next)) {
+    if (!reversed_) {
+      reversed_ = true;
+      direction_ = -direction_;
+      next = candidate();
+    } else {
+      next = 0;
+    }
+    if (!fits(next)) {
+      settled_ = true;
+      Move(best_, why.str() + ", settling on " + std::to_string(best_));
+      return true;
+    }
+  }
+  Move(static_cast<size_t>(next), why.str() + ", trying " + std::to_string(next));
+  return true;
+}
+
+void JobTuner::Move(size_t next, const std::string& why) {
+  warmup_ = next == limit_ ? 0 : limit_;
+  limit_ = next;
+  reason_ = why;
+}
+
+static auto HostName() -> std::string {
+  char name[256] = {};
+  if (::gethostname(name, sizeof(name) - 1) != 0) {
+    return "localhost";
+  }
+  return name;
+}
+
+static auto LoadAll(const std::string& path) -> std::map<std::string, size_t> {
+  std::map<std::string, size_t> jobs;
+  std::ifstream stream(path);
+  for (std::string line; std::getline(stream, line);) {
+    const auto pos = line.find('\t');
+    if (pos == std::string::npos) {
+      continue;
+    }
+    try {
+      jobs[line.substr(0, pos)] = std::stoul(line.substr(pos + 1));
+    } catch (const std::exception&) {
+    }
+  }
+  return jobs;
+}
+
+auto LoadTunedJobs(const std::string& path) -> std::optional<size_t> {
+  const auto& jobs = LoadAll(path);
+  const auto& iter = jobs.find(HostName());
+  if (iter == jobs.end() || iter->second == 0) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+auto SaveTunedJobs(const std::string& path, size_t jobs) -> bool {
+  auto all = LoadAll(path);
+  all[HostName()] = jobs;
+  std::ofstream stream(path);
+  for (const auto& [host, value] : all) {
+    stream << host << '\t' << value << '\n';
+  }
+  return static_cast<bool>(stream.flush());
+}
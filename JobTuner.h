@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// Hill-climbs the number of compiles run at once for jobs=auto. Throughput
+// is measured over windows of finished compiles, each worth the seconds it
+// took last time, so that heavy and light sources weigh what they cost. The
+// limit moves one step in a direction while that helps, tries the other side
+// of the best limit once, then settles on the best.
+class JobTuner {
+ public:
+  JobTuner(size_t start, size_t max);
+
+  // Records a compile finished at `now`, both in seconds; true if Limit()
+  // changed, with Reason() saying why.
+  auto Record(double now, double work) -> bool;
+
+  [[nodiscard]] auto Limit() const -> size_t {
+    return limit_;
+  }
+
+  [[nodiscard]] auto Best() const -> size_t {
+    return best_;
+  }
+
+  // whether a whole window was measured, i.e. Best() is worth keeping
+  [[nodiscard]] auto Measured() const -> bool {
+    return best_rate_ >= 0;
+  }
+
+  [[nodiscard]] auto Reason() const -> const std::string& {
+    return reason_;
+  }
+
+ private:
+  void Move(size_t next, const std::string& why);
+
+ private:
+  size_t limit_;
+  size_t max_;
+  size_t step_;
+  int direction_;
+  bool reversed_ = false;
+  bool settled_ = false;
+  size_t best_;
+  double best_rate_ = -1;
+  // compiles still running from before a change are not counted
+  size_t warmup_;
+  size_t count_ = 0;
+  double start_ = 0;
+  double work_ = 0;
+  std::string reason_;
+};
+
+// The jobs=auto limit that worked best on this host, kept in `path` by host name.
+auto LoadTunedJobs(const std::string& path) -> std::optional<size_t>;
+auto SaveTunedJobs(const std::string& path, size_t jobs) -> bool;
@@ -0,0 +1,184 @@
+#include "Jobserver.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <string_view>
+
+static auto FindJobserverAuth(const std::string& makeflags) -> std::string {
+  std::istringstream stream(makeflags);
+  std::string auth;
+  for (std::string word; stream >> word;) {
+    for (const auto& prefix : {"--jobserver-auth=", "--jobserver-fds="}) {
+      const std::string_view view(prefix);
+      if (word.compare(0, view.size(), view) == 0) {
+        auth = word.substr(view.size());
+      }
+    }
+  }
+  return auth;
+}
+
+// std::exit skips destructors, and tokens that never go back to the pipe are
+// lost to the parent make for good
+static Jobserver* exiting_client = nullptr;
+
+static void ReleaseAtExit() {
+  if (exiting_client != nullptr) {
+    exiting_client->ReleaseAll();
+  }
+}
+
+static auto IsOpen(int fd) -> bool {
+  return fd >= 0 && ::fcntl(fd, F_GETFD) != -1;
+}
+
+Jobserver::~Jobserver() {
+  if (exiting_client == this) {
+    ReleaseAll();
+    exiting_client = nullptr;
+  }
+  if (poll_fd_ >= 0 && poll_fd_ != read_fd_) {
+    ::close(poll_fd_);
+  }
+  if (owner_) {
+    if (write_fd_ != read_fd_) {
+      ::close(write_fd_);
+    }
+    ::close(read_fd_);
+  }
+}
+
+auto Jobserver::Setup(size_t jobs) -> bool {
+  const auto* makeflags = std::getenv("MAKEFLAGS");
+  if (makeflags != nullptr) {
+    const auto& auth = FindJobserverAuth(makeflags);
+    if (!auth.empty()) {
+      return Attach(auth);
+    }
+  }
+  return Serve(jobs);
+}
+
+auto Jobserver::Attach(const std::string& auth) -> bool {
+  if (auth.compare(0, 5, "fifo:") == 0) {
+    const auto& path = auth.substr(5);
+    read_fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (read_fd_ < 0) {
+      return false;
+    }
+    write_fd_ = read_fd_;
+    poll_fd_ = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    owner_ = true;
+  } else {
+    int r = -1;
+    int w = -1;
+    char comma = 0;
+    std::istringstream stream(auth);
+    if (!(stream >> r >> comma >> w) || comma != ',' || !IsOpen(r) || !IsOpen(w)) {
+      return false;
+    }
+    read_fd_ = r;
+    write_fd_ = w;
+#ifdef __linux__
+    // a private non-blocking description of the shared pipe
+    const auto& proc = "/proc/self/fd/" + std::to_string(r);
+    poll_fd_ = ::open(proc.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+#endif
+  }
+  if (poll_fd_ < 0) {
+    poll_fd_ = read_fd_;
+  }
+  active_ = true;
+  description_ = "jobserver client (" + auth + ")";
+  if (exiting_client == nullptr) {
+    static const auto registered = std::atexit(ReleaseAtExit) == 0;
+    exiting_client = registered ? this : nullptr;
+  }
+  return true;
+}
+
+auto Jobserver::Serve(size_t jobs) -> bool {
+  int fds[2];
+  if (::pipe(fds) != 0) {
+    return false;
+  }
+  read_fd_ = fds[0];
+  write_fd_ = fds[1];
+  owner_ = true;
+  const std::string tokens(jobs > 1 ? jobs - 1 : 0, '+');
+  if (!tokens.empty() && ::write(write_fd_, tokens.data(), tokens.size()) != static_cast<ssize_t>(tokens.size())) {
+    return false;
+  }
+#ifdef __linux__
+  poll_fd_ = ::open(("/proc/self/fd/" + std::to_string(read_fd_)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+#endif
+  if (poll_fd_ < 0) {
+    poll_fd_ = read_fd_;
+  }
+  const auto& auth = std::to_string(read_fd_) + ',' + std::to_string(write_fd_);
+  std::string makeflags;
+  if (const auto* value = std::getenv("MAKEFLAGS")) {
+    makeflags = value;
+  }
+  makeflags += " -j" + std::to_string(jobs) + " --jobserver-auth=" + auth;
+  ::setenv("MAKEFLAGS", makeflags.c_str(), 1);
+  active_ = true;
+  description_ = "jobserver server (" + std::to_string(jobs) + " tokens, " + auth + ")";
+  return true;
+}
+
+auto Jobserver::TryAcquire() -> bool {
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (implicit_) {
+      implicit_ = false;
+      return true;
+    }
+    if (!active_) {
+      return true;
+    }
+  }
+  pollfd pfd{poll_fd_, POLLIN, 0};
+  if (::poll(&pfd, 1, 0) <= 0 || (pfd.revents & POLLIN) == 0) {
+    return false;
+  }
+  char token = 0;
+  const auto n = ::read(poll_fd_, &token, 1);
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (n == 1) {
+    tokens_.push_back(token);
+    return true;
+  }
+  if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    active_ = false;
+    return true;
+  }
+  return false;
+}
+
+void Jobserver::ReleaseAll() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  for (const auto token : tokens_) {
+    while (::write(write_fd_, &token, 1) < 0 && errno == EINTR) {
+    }
+  }
+  tokens_.clear();
+  implicit_ = true;
+}
+
+void Jobserver::Release() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (tokens_.empty()) {
+    implicit_ = true;
+    return;
+  }
+  const auto token = tokens_.back();
+  tokens_.pop_back();
+  while (::write(write_fd_, &token, 1) < 0 && errno == EINTR) {
+  }
+}
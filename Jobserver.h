@@ -0,0 +1,52 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Client and server side of the GNU make jobserver protocol. Every running
+// job holds a token; the first one is implicit, the rest are bytes read from
+// the shared pipe or fifo and written back when the job finishes.
+class Jobserver {
+ public:
+  Jobserver() = default;
+  Jobserver(const Jobserver&) = delete;
+  Jobserver(Jobserver&&) = delete;
+  auto operator=(const Jobserver&) -> Jobserver& = delete;
+  auto operator=(Jobserver&&) -> Jobserver& = delete;
+  ~Jobserver();
+
+  // Joins the jobserver advertised in MAKEFLAGS, or serves `jobs` tokens to
+  // our own children by exporting a new one through MAKEFLAGS.
+  auto Setup(size_t jobs) -> bool;
+
+  // Never blocks; on false, PollFd() becomes readable once a token may be
+  // available, unless the implicit token is released first.
+  auto TryAcquire() -> bool;
+  void Release();
+  // Returns every token still held, e.g. by children nobody waits for anymore.
+  void ReleaseAll();
+
+  [[nodiscard]] auto PollFd() const -> int {
+    return poll_fd_;
+  }
+
+  [[nodiscard]] auto Description() const -> const std::string& {
+    return description_;
+  }
+
+ private:
+  auto Attach(const std::string& auth) -> bool;
+  auto Serve(size_t jobs) -> bool;
+
+ private:
+  int read_fd_ = -1;
+  int write_fd_ = -1;
+  int poll_fd_ = -1;
+  bool active_ = false;
+  bool owner_ = false;
+  std::string description_;
+  std::mutex mutex_;
+  bool implicit_ = true;
+  std::vector<char> tokens_;
+};
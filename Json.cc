@@ -0,0 +1,292 @@
+#include "Json.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+class JsonParser {
+ public:
+  explicit JsonParser(std::string_view text)
+    : text_(text) {
+  }
+
+  auto ParseDocument() -> std::optional<JsonValue> {
+    JsonValue value;
+    if (!ParseValue(value, 0)) {
+      return std::nullopt;
+    }
+    SkipSpaces();
+    if (pos_ != text_.size()) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+ private:
+  static constexpr size_t kMaxDepth = 256;
+
+  void SkipSpaces() {
+    while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  auto Consume(std::string_view token) -> bool {
+    if (text_.substr(pos_, token.size()) != token) {
+      return false;
+    }
+    pos_ += token.size();
+    return true;
+  }
+
+  auto ParseValue(JsonValue& value, size_t depth) -> bool {
+    if (depth > kMaxDepth) {
+      return false;
+    }
+    SkipSpaces();
+    if (pos_ >= text_.size()) {
+      return false;
+    }
+    switch (text_[pos_]) {
+      case '{':
+        return ParseObject(value, depth);
+      case '[':
+        return ParseArray(value, depth);
+      case '"':
+        value.type_ = JsonValue::Type::String;
+        return ParseString(value.string_);
+      case 't':
+        value.type_ = JsonValue::Type::Bool;
+        value.bool_ = true;
+        return Consume("true");
+      case 'f':
+        value.type_ = JsonValue::Type::Bool;
+        value.bool_ = false;
+        return Consume("false");
+      case 'n':
+        value.type_ = JsonValue::Type::Null;
+        return Consume("null");
+      default:
+        return ParseNumber(value);
+    }
+  }
+
+  auto ParseObject(JsonValue& value, size_t depth) -> bool {
+    value.type_ = JsonValue::Type::Object;
+    ++pos_;
+    SkipSpaces();
+    if (Consume("}")) {
+      return true;
+    }
+    while (true) {
+      SkipSpaces();
+      std::string key;
+      if (pos_ >= text_.size() || text_[pos_] != '"' || !ParseString(key)) {
+        return false;
+      }
+      SkipSpaces();
+      if (!Consume(":")) {
+        return false;
+      }
+      JsonValue member;
+      if (!ParseValue(member, depth + 1)) {
+        return false;
+      }
+      value.object_.emplace_back(std::move(key), std::move(member));
+      SkipSpaces();
+      if (Consume("}")) {
+        return true;
+      }
+      if (!Consume(",")) {
+        return false;
+      }
+    }
+  }
+
+  auto ParseArray(JsonValue& value, size_t depth) -> bool {
+    value.type_ = JsonValue::Type::Array;
+    ++pos_;
+    SkipSpaces();
+    if (Consume("]")) {
+      return true;
+    }
+    while (true) {
+      JsonValue element;
+      if (!ParseValue(element, depth + 1)) {
+        return false;
+      }
+      value.array_.push_back(std::move(element));
+      SkipSpaces();
+      if (Consume("]")) {
+        return true;
+      }
+      if (!Consume(",")) {
+        return false;
+      }
+    }
+  }
+
+  static void AppendUtf8(std::string& out, unsigned long code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xc0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xe0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  auto ParseHex4(unsigned long& code) -> bool {
+    if (pos_ + 4 > text_.size()) {
+      return false;
+    }
+    code = 0;
+    for (const auto c : text_.substr(pos_, 4)) {
+      if (!std::isxdigit(static_cast<unsigned char>(c))) {
+        return false;
+      }
+      code = code * 16 + (std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(c) - 'a' + 10);
+    }
+    pos_ += 4;
+    return true;
+  }
+
+  auto ParseString(std::string& out) -> bool {
+    ++pos_;
+    while (pos_ < text_.size()) {
+      const auto c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ >= text_.size()) {
+        return false;
+      }
+      const auto escaped = text_[pos_++];
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          out += escaped;
+          break;
+        case 'b':
+          out += '\b';
+          break;
+        case 'f':
+          out += '\f';
+          break;
+        case 'n':
+          out += '\n';
+          break;
+        case 'r':
+          out += '\r';
+          break;
+        case 't':
+          out += '\t';
+          break;
+        case 'u': {
+          unsigned long code = 0;
+          if (!ParseHex4(code)) {
+            return false;
+          }
+          if (code >= 0xd800 && code < 0xdc00 && Consume("\\u")) {
+            unsigned long low = 0;
+            if (!ParseHex4(low) || low < 0xdc00 || low > 0xdfff) {
+              return false;
+            }
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+          }
+          AppendUtf8(out, code);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  auto ParseNumber(JsonValue& value) -> bool {
+    const auto start = pos_;
+    while (pos_ < text_.size() && std::string_view("+-0123456789.eE").find(text_[pos_]) != std::string_view::npos) {
+      ++pos_;
+    }
+    if (start == pos_) {
+      return false;
+    }
+    const std::string digits(text_.substr(start, pos_ - start));
+    char* end = nullptr;
+    value.type_ = JsonValue::Type::Number;
+    value.number_ = std::strtod(digits.c_str(), &end);
+    return end == digits.c_str() + digits.size();
+  }
+
+ private:
+  std::string_view text_;
+  size_t pos_ = 0;
+};
+
+auto JsonValue::Parse(std::string_view text) -> std::optional<JsonValue> {
+  return JsonParser(text).ParseDocument();
+}
+
+auto JsonValue::ParseFile(const std::string& path) -> std::optional<JsonValue> {
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    return std::nullopt;
+  }
+  std::ostringstream buffer;
+  buffer << stream.rdbuf();
+  return Parse(buffer.str());
+}
+
+auto JsonValue::Find(std::string_view key) const -> const JsonValue* {
+  if (type_ != Type::Object) {
+    return nullptr;
+  }
+  for (const auto& [name, value] : object_) {
+    if (name == key) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+auto JsonQuote(std::string_view str) -> std::string {
+  std::ostringstream stream;
+  stream << '"';
+  for (const auto c : str) {
+    switch (c) {
+      case '"':
+        stream << "\\\"";
+        break;
+      case '\\':
+        stream << "\\\\";
+        break;
+      case '\n':
+        stream << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+          stream << c;
+        }
+    }
+  }
+  stream << '"';
+  return stream.str();
+}
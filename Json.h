@@ -0,0 +1,68 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class JsonValue {
+ public:
+  enum class Type {
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object,
+  };
+
+  using Array = std::vector<JsonValue>;
+  using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+  static auto Parse(std::string_view text) -> std::optional<JsonValue>;
+  static auto ParseFile(const std::string& path) -> std::optional<JsonValue>;
+
+  [[nodiscard]] auto GetType() const -> Type {
+    return type_;
+  }
+
+  [[nodiscard]] auto IsNull() const -> bool {
+    return type_ == Type::Null;
+  }
+
+  [[nodiscard]] auto AsBool(bool fallback = false) const -> bool {
+    return type_ == Type::Bool ? bool_ : fallback;
+  }
+
+  [[nodiscard]] auto AsNumber(double fallback = 0) const -> double {
+    return type_ == Type::Number ? number_ : fallback;
+  }
+
+  [[nodiscard]] auto AsString() const -> const std::string& {
+    return string_;
+  }
+
+  [[nodiscard]] auto AsArray() const -> const Array& {
+    return array_;
+  }
+
+  [[nodiscard]] auto AsObject() const -> const Object& {
+    return object_;
+  }
+
+  // nullptr if this is not an object or has no such key
+  [[nodiscard]] auto Find(std::string_view key) const -> const JsonValue*;
+
+ private:
+  friend class JsonParser;
+
+  Type type_ = Type::Null;
+  bool bool_ = false;
+  double number_ = 0;
+  std::string string_;
+  Array array_;
+  Object object_;
+};
+
+auto JsonQuote(std::string_view str) -> std::string;
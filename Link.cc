@@ -0,0 +1,277 @@
+#include "Link.h"
+#include "ResponseFile.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+FastLinkers::FastLinkers(const std::map<std::string, std::string>& args, size_t threads, bool verbose)
+  : args_(args),
+    threads_(threads),
+    verbose_(verbose),
+    cache_((std::filesystem::path(args.at("workdir")) / ".sb_probe").string()) {
+}
+
+auto FastLinkers::Flags(const Linker& linker, const std::string& ldflags) -> std::pair<std::string, std::string> {
+  const auto explicit_ld = linker.priority == Linker::ForLd(linker.command).priority;
+  if (args_.at("fuse-ld") != "auto" || explicit_ld || ldflags.find("-fuse-ld=") != std::string::npos) {
+    return {ldflags, ""};
+  }
+  std::lock_guard<std::mutex> locker(mutex_);
+  auto iter = linkers_.find(linker.command);
+  if (iter == linkers_.end()) {
+    iter = linkers_.emplace(linker.command, ProbeFastLinker(linker.command, threads_, cache_)).first;
+    if (verbose_ && iter->second) {
+      std::cout << "(I) linking with " << iter->second.name << " through " << linker.command << std::endl;
+    } else if (verbose_) {
+      std::cout << "(I) no mold, lld or gold for " << linker.command << ", keeping its linker" << std::endl;
+    }
+  }
+  return {JoinStrings({ldflags, iter->second.flags}), iter->second.name};
+}
+
+void FastLinkers::Drop(const Linker& linker) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  DropFastLinker(linker.command, cache_);
+}
+
+LinkStage::LinkStage(BuildContext& build, FastLinkers& fast_linkers, const std::vector<size_t>& stale)
+  : build_(build),
+    fast_linkers_(fast_linkers),
+    stale_(stale),
+    relinks_(build.project.targets.size(), 0),
+    packages_(build.project.targets.size(), 0),
+    changed_(build.project.targets.size()) {
+}
+
+void LinkStage::Count() {
+  const auto& targets = build_.project.targets;
+  for (size_t t = 0; t < targets.size(); ++t) {
+    const auto& dependencies = targets[t].dependencies;
+    relinks_[t] = stale_[t] > 0 || !std::filesystem::exists(targets[t].output) ||
+      (targets[t].type != TargetType::Static && std::any_of(dependencies.begin(), dependencies.end(), [&](auto dependency) {
+        return relinks_[dependency] != 0;
+      }));
+    packages_[t] = !build_.args.at("dwp").empty() && targets[t].type != TargetType::Static &&
+      (relinks_[t] || !std::filesystem::exists(targets[t].output + ".dwp"));
+  }
+  build_.total -= std::count(relinks_.begin(), relinks_.end(), 0);
+  build_.total += std::count(packages_.begin(), packages_.end(), 1);
+}
+
+void LinkStage::Add(std::vector<std::vector<cab::TaskGraph::Id>> predecessors, const std::vector<double>& tails) {
+  const auto& targets = build_.project.targets;
+  tails_ = tails;
+  std::vector<cab::TaskGraph::Id> link_ids;
+  for (size_t t = 0; t < targets.size(); ++t) {
+    for (const auto dependency : targets[t].dependencies) {
+      predecessors[t].push_back(link_ids[dependency]);
+    }
+    link_ids.push_back(build_.graph.AddAsync([this, t](cab::TaskGraph::Done done) {
+      Link(t, std::move(done));
+    }, predecessors[t], tails_[t]));
+  }
+  for (size_t t = 0; !build_.args.at("dwp").empty() && t < targets.size(); ++t) {
+    if (targets[t].type != TargetType::Static) {
+      build_.graph.AddAsync([this, t](cab::TaskGraph::Done done) {
+        Package(t, std::move(done));
+      }, {link_ids[t]}, tails_[t]);
+    }
+  }
+}
+
+auto LinkStage::Changed() const -> bool {
+  return std::any_of(changed_.begin(), changed_.end(), [](const auto& flag) { return flag.load(); });
+}
+
+void LinkStage::Link(size_t t, cab::TaskGraph::Done done) {
+  const auto& target = build_.project.targets[t];
+  const auto& files = build_.files;
+  const auto& owners = build_.owners;
+  auto& linkers = build_.linkers;
+  auto& log = build_.log;
+  const auto cutoff = build_.args.at("cutoff") == "1";
+  const auto& dependencies = target.dependencies;
+  for (const auto dependency : dependencies) {
+    if (linkers[dependency] > linkers[t]) {
+      linkers[t] = linkers[dependency];
+    }
+  }
+  const auto upstream = std::any_of(dependencies.begin(), dependencies.end(), [&](auto dependency) {
+    return changed_[dependency].load();
+  });
+  const auto archive = target.type == TargetType::Static;
+  // with cutoff, the link record keeps a hash of the object contents it
+  // was made from, so objects saved by a build that never linked still
+  // relink the next time
+  uint64_t linked_from = kHashSeed;
+  for (size_t i = 0; cutoff && i < files.size(); ++i) {
+    if (owners[i] != t || !files[i]) {
+      continue;
+    }
+    auto record = log.Find(files[i].output).value_or(BuildRecord{});
+    if (record.content == 0) {
+      record.content = HashFile(files[i].output).value_or(0);
+      log.Update(files[i].output, record);
+    }
+    linked_from = HashBytes(std::to_string(record.content), linked_from);
+  }
+  const auto previous = log.Find(target.output);
+  // archives do not contain what they depend on
+  const auto relink =
+    (cutoff ? !previous || previous->input != linked_from : stale_[t] > 0) || (upstream && !archive) ||
+    !std::filesystem::exists(target.output);
+  if (!relink) {
+    std::lock_guard<std::mutex> locker(build_.mutex);
+    build_.total -= relinks_[t];
+    changed_[t] = upstream;
+    if (build_.verbose && stale_[t] > 0) {
+      std::cout << "(I) objects unchanged, keeping " << target.output << std::endl;
+    }
+    done(true);
+    return;
+  }
+  std::vector<std::string> inputs;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (owners[i] == t && files[i]) {
+      inputs.push_back(files[i].output);
+    }
+  }
+  const auto& response = target.output + ".rsp";
+  const auto& objects = ResponseArguments(inputs, response, std::stoul(build_.args.at("rsp")));
+  std::string command;
+  std::string fallback;
+  std::string fast;
+  if (archive) {
+    command = JoinStrings({"rm -f", target.output, "&&", target.args.at("ar"), "rcs", target.output, objects});
+  } else {
+    const auto& ld = linkers[t].command;
+    if (ld.empty()) {
+      std::cerr << "(E) undetermined linker" << std::endl;
+      failed_ = true;
+      done(false);
+      return;
+    }
+    auto [ldflags, name] = fast_linkers_.Flags(linkers[t], target.args.at("ldflags"));
+    fast = name;
+    std::string extra;
+    if (target.args.at("fission") == "1" && ProbeLinkerFlag(ld, "-Wl,--gdb-index")) {
+      extra = "-Wl,--gdb-index";
+    }
+    const auto& libraries = JoinStrings(LinkInputs(build_.project, t));
+    command = JoinStrings({ld, ldflags, extra, "-o", target.output, objects, libraries});
+    if (!fast.empty()) {
+      fallback = JoinStrings({ld, target.args.at("ldflags"), extra, "-o", target.output, objects, libraries});
+    }
+  }
+  build_.Progress(build_.verbose ? command : target.output);
+  const auto start = build_.watch.Elapsed();
+  const auto finish = [this, t, objects, response, start, previous, linked_from, cutoff, done](const ProcessResult& process, const std::string& fast) {
+    const auto& target = build_.project.targets[t];
+    const auto ok = static_cast<bool>(process);
+    if (ok && build_.verbose && !fast.empty()) {
+      std::lock_guard<std::mutex> locker(build_.mutex);
+      std::cout << "(I) linked " << target.output << " with " << fast << " in " << std::fixed << std::setprecision(2) << process.wall << "s";
+      if (previous) {
+        std::cout << ", " << previous->wall << "s last time";
+      }
+      std::cout << std::endl;
+    }
+    if (ok) {
+      std::vector<std::string> byproducts;
+      if (objects[0] == '@') {
+        byproducts.push_back(response);
+      }
+      build_.log.Update(target.output, {process.wall, process.user, process.system, process.max_rss, cutoff ? linked_from : 0, 0, std::move(byproducts)});
+    } else {
+      std::cerr << "(E) failed to link " << target.output << std::endl;
+      failed_ = true;
+    }
+    changed_[t] = ok;
+    Finish(start);
+    done(ok);
+  };
+  // a fast linker that stopped working falls back to the driver's own
+  build_.processes.Spawn(command, [this, t, fallback, fast, finish](const ProcessResult& process) {
+    if (process || fallback.empty()) {
+      finish(process, fast);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> locker(build_.mutex);
+      std::cerr << "(W) linking " << build_.project.targets[t].output << " with " << fast << " failed, retrying with the default linker" << std::endl;
+    }
+    build_.processes.Spawn(fallback, [this, t, finish](const ProcessResult& process) {
+      if (process) {
+        fast_linkers_.Drop(build_.linkers[t]);
+      }
+      finish(process, "");
+    }, 0, tails_[t]);
+  }, 0, tails_[t]);
+}
+
+void LinkStage::Package(size_t t, cab::TaskGraph::Done done) {
+  const auto& targets = build_.project.targets;
+  const auto& files = build_.files;
+  const auto& package = targets[t].output + ".dwp";
+  if (!changed_[t] && std::filesystem::exists(package)) {
+    std::lock_guard<std::mutex> locker(build_.mutex);
+    build_.total -= packages_[t];
+    done(true);
+    return;
+  }
+  std::vector<char> members(targets.size(), 0);
+  members[t] = 1;
+  for (size_t d = t; d-- > 0;) {
+    for (size_t u = d + 1; u <= t && !members[d]; ++u) {
+      const auto& dependencies = targets[u].dependencies;
+      members[d] = members[u] && targets[d].type == TargetType::Static &&
+        std::find(dependencies.begin(), dependencies.end(), d) != dependencies.end();
+    }
+  }
+  std::vector<std::string> dwos;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (members[build_.owners[i]] && files[i]) {
+      for (const auto& byproduct : files[i].byproducts) {
+        if (std::filesystem::path(byproduct).extension() == ".dwo") {
+          dwos.push_back(byproduct);
+        }
+      }
+    }
+  }
+  const auto& response = package + ".rsp";
+  const auto& objects = ResponseArguments(dwos, response, std::stoul(build_.args.at("rsp")));
+  const auto& command = JoinStrings({build_.args.at("dwp"), "-o", package, objects});
+  if (!packages_[t]) {
+    std::lock_guard<std::mutex> locker(build_.mutex);
+    ++build_.total;
+  }
+  build_.Progress(build_.verbose ? command : package);
+  const auto start = build_.watch.Elapsed();
+  build_.processes.Spawn(command, [this, package, response, objects, start, done](const ProcessResult& process) {
+    const auto ok = static_cast<bool>(process);
+    if (ok) {
+      std::vector<std::string> byproducts;
+      if (objects[0] == '@') {
+        byproducts.push_back(response);
+      }
+      build_.log.Update(package, {process.wall, process.user, process.system, process.max_rss, 0, 0, std::move(byproducts)});
+    } else {
+      std::cerr << "(E) failed to package debug info of " << package << std::endl;
+      failed_ = true;
+    }
+    Finish(start);
+    done(ok);
+  }, 0, tails_[t]);
+}
+
+// link time runs from the first link or package started to the last one done
+void LinkStage::Finish(double start) {
+  std::lock_guard<std::mutex> locker(build_.mutex);
+  if (start_ < 0 || start < start_) {
+    start_ = start;
+  }
+  build_.metrics.link = build_.watch.Elapsed() - start_;
+}
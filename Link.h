@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cab/TaskGraph.h"
+
+#include "Build.h"
+#include "SourceAnalyzer.h"
+#include "Toolchain.h"
+
+// With fuse-ld=auto, links through mold, lld or gold on every job when the
+// compiler driver can, unless ld= or -fuse-ld= already say otherwise.
+// Probes are kept in <workdir>/.sb_probe.
+class FastLinkers {
+ public:
+  FastLinkers(const std::map<std::string, std::string>& args, size_t threads, bool verbose);
+
+  // `ldflags` with those selecting the fast linker for `linker`, and the
+  // name of that linker, empty when it keeps its own.
+  auto Flags(const Linker& linker, const std::string& ldflags) -> std::pair<std::string, std::string>;
+  // Keeps the default linker of `linker` in later builds after a failed link.
+  void Drop(const Linker& linker);
+
+ private:
+  const std::map<std::string, std::string>& args_;
+  size_t threads_;
+  bool verbose_;
+  std::string cache_;
+  std::mutex mutex_;
+  std::map<std::string, FastLinker> linkers_;
+};
+
+// Links each target once its objects and the targets it links against are
+// done, then packages the split debug info of executables and shared
+// libraries with dwp=, along with that of the static libraries in them.
+class LinkStage {
+ public:
+  LinkStage(BuildContext& build, FastLinkers& fast_linkers, const std::vector<size_t>& stale);
+
+  // Takes the links and packages that will not run out of the progress
+  // total once every source is analyzed; the caller holds the lock.
+  void Count();
+  // Adds the tasks of each target after `predecessors[t]`, prioritized by
+  // the estimated time from there to the end of the build.
+  void Add(std::vector<std::vector<cab::TaskGraph::Id>> predecessors, const std::vector<double>& tails);
+
+  // whether any target is newer than in the last build
+  [[nodiscard]] auto Changed() const -> bool;
+  [[nodiscard]] auto Failed() const -> bool {
+    return failed_;
+  }
+
+ private:
+  void Link(size_t t, cab::TaskGraph::Done done);
+  void Package(size_t t, cab::TaskGraph::Done done);
+  void Finish(double start);
+
+ private:
+  BuildContext& build_;
+  FastLinkers& fast_linkers_;
+  // stale sources of each target
+  const std::vector<size_t>& stale_;
+  std::vector<double> tails_;
+  // counted in progress
+  std::vector<char> relinks_;
+  std::vector<char> packages_;
+  std::vector<std::atomic_bool> changed_;
+  std::atomic_bool failed_ = false;
+  double start_ = -1;
+};
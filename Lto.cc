@@ -0,0 +1,70 @@
+#include "Lto.h"
+#include "Toolchain.h"
+#include "Utils.h"
+
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static void AddFlags(std::map<std::string, std::string>& args, const std::string& compile, const std::string& link) {
+  for (const auto& key : {"cflags", "cxxflags"}) {
+    args.at(key) = JoinStrings({args.at(key), compile});
+  }
+  args.at("ldflags") = JoinStrings({args.at("ldflags"), link});
+}
+
+// "-fuse-ld=gold" => "gold"
+static auto UsedLinker(const std::string& ldflags) -> std::string {
+  const std::string option = "-fuse-ld=";
+  const auto pos = ldflags.rfind(option);
+  if (pos == std::string::npos) {
+    return "";
+  }
+  const auto begin = pos + option.size();
+  return ldflags.substr(begin, ldflags.find(' ', begin) - begin);
+}
+
+auto SetupThinLto(std::map<std::string, std::string>& args) -> LtoSetup {
+  if (args.at("thinlto") != "1") {
+    return {};
+  }
+  auto jobs = args.at("jobs") == "auto" ? 0 : std::stoul(args.at("jobs"));
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const auto& threads = std::to_string(jobs);
+  const auto& cache = (fs::absolute(args.at("workdir")) / "thinlto-cache").lexically_normal();
+  const auto kind = ProbeCompilerKind(args.at("cxx"));
+  // gcc 15 reuses unchanged partitions from the cache
+  const auto& incremental = "-flto-incremental=" + cache.string();
+  const auto cached = kind == CompilerKind::Clang || ProbeLinkerFlag(args.at("cxx"), "-flto " + incremental);
+  std::error_code err;
+  if (cached && !fs::create_directories(cache, err) && err) {
+    return {false, "failed to create " + cache.string(), {}};
+  }
+  if (kind != CompilerKind::Clang) {
+    const auto& link = JoinStrings({"-flto=" + threads, cached ? incremental : ""});
+    AddFlags(args, "-flto", link);
+    return {true, {}, "gcc has no ThinLTO, using " + link};
+  }
+  std::string link;
+#ifdef __APPLE__
+  link = "-flto=thin -Wl,-cache_path_lto," + cache.string() + " -Wl,-mllvm,-threads=" + threads;
+#else
+  const auto& linker = UsedLinker(args.at("ldflags"));
+  if (linker.empty() && !ProbeLinkerFlag(args.at("cxx"), "-fuse-ld=lld")) {
+    return {false, "thinlto needs lld, or -fuse-ld= naming a linker with the LLVM plugin", {}};
+  }
+  if (linker.empty() || linker == "lld") {
+    link = JoinStrings({
+      "-flto=thin", linker.empty() ? "-fuse-ld=lld" : "",
+      "-Wl,--thinlto-cache-dir=" + cache.string(), "-Wl,--thinlto-jobs=" + threads});
+  } else {
+    // gold and mold run the LLVM plugin
+    link = "-flto=thin -Wl,-plugin-opt,cache-dir=" + cache.string() + " -Wl,-plugin-opt,jobs=" + threads;
+  }
+#endif
+  AddFlags(args, "-flto=thin", link);
+  return {true, {}, link};
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+struct LtoSetup {
+  bool ok = true;
+  std::string error;
+  // what thinlto=1 turned into
+  std::string description;
+};
+
+// Adjusts flags for thinlto=1. Clang compiles with -flto=thin and links with
+// a cache in <workdir>/thinlto-cache and one backend job per job. gcc has no
+// ThinLTO and gets -flto=<jobs> instead, with -flto-incremental where the
+// compiler has it.
+auto SetupThinLto(std::map<std::string, std::string>& args) -> LtoSetup;
@@ -1,15 +1,35 @@
 #include "MakeParser.h"
+#include "Tests.h"
 
 using cab::ArgumentParser;
 
 auto MakeParser() -> ArgumentParser {
   return ArgumentParser()
     .On("clean", "clean files", ArgumentParser::Set("0", "1"))
-    .On("jobs", "set number of jobs", ArgumentParser::Set("0", "0"))
+    .On("gc", "remove objects whose sources are gone", ArgumentParser::Set("0", "1"))
+    .On("jobs", "set number of jobs, or auto to tune it", ArgumentParser::Set("0", "auto"))
+    .On("jobserver", "share jobs through make jobserver", ArgumentParser::Set("1", "1"))
     .On("target", "set target name", ArgumentParser::Set("a.out", "a.out"))
+    .On("project", "build the targets declared in a json manifest", ArgumentParser::Set("", "sb.json"))
     .On("workdir", "set working directory", ArgumentParser::Set(".", "."))
     .On("verbose", "set verbose level", ArgumentParser::Set("0", "1"))
+    .On("rsp", "set command length for using response files", ArgumentParser::Set("32768", "32768"))
+    .On("impact", "show rebuild impact of a file or rank headers", ArgumentParser::Set("", "*"))
+    .On("top", "set number of entries in reports", ArgumentParser::Set("10", "10"))
+    .On("modules", "build C++20 modules, ordering interfaces before importers", ArgumentParser::Set("0", "1"))
+    .On("cutoff", "skip work when preprocessed input or objects are unchanged", ArgumentParser::Set("0", "1"))
+    .On("profile-headers", "report header and template costs from clang -ftime-trace",
+        ArgumentParser::Set("0", "1"),
+        ArgumentParser::JoinTo("cflags", {}, "-ftime-trace"),
+        ArgumentParser::JoinTo("cxxflags", {}, "-ftime-trace"))
+    .On("test", "build and run each matching source as a test", ArgumentParser::Set("", kDefaultTestPattern))
+    .On("shard", "run the i-th of n test shards (i/n)", ArgumentParser::Set("", ""))
+    .On("timeout", "set seconds a test may run", ArgumentParser::Set("60", "60"))
+    .On("ninja", "write a build.ninja instead of building", ArgumentParser::Set("", "build.ninja"))
+    .On("ninja-sources", "only refresh the source list watched by build.ninja", ArgumentParser::Set("0", "1"))
+    .On("metrics", "write build metrics to file (json or .prom)", ArgumentParser::Set("", ""))
     .Split()
+    .On("ar", "set archiver", ArgumentParser::Set("ar", "ar"))
     .On("as", "set assembler", ArgumentParser::Set("as", "as"))
     .On("asflags", "add assembler flags", ArgumentParser::Join("", {}))
     .On("cc", "set c compiler", ArgumentParser::Set("cc", "cc"))
@@ -17,7 +37,9 @@ auto MakeParser() -> ArgumentParser {
     .On("cxx", "set c++ compiler", ArgumentParser::Set("c++", "c++"))
     .On("cxxflags", "add c++ compiler flags", ArgumentParser::Join("", {}))
     .On("ld", "set linker", ArgumentParser::Set("", ""))
+    .On("fuse-ld", "link with mold, lld or gold if found (auto) or not (none)", ArgumentParser::Set("auto", "auto"))
     .On("ldflags", "add linker flags", ArgumentParser::Join("", {}))
+    .On("profdata", "set llvm profile merger", ArgumentParser::Set("llvm-profdata", "llvm-profdata"))
     .On("prefix", "add search directories",
         ArgumentParser::JoinTo(
           "cflags", {}, {},
@@ -44,6 +66,11 @@ auto MakeParser() -> ArgumentParser {
     .On("debug", "enable -g",
         ArgumentParser::JoinTo("cflags", {}, "-g"),
         ArgumentParser::JoinTo("cxxflags", {}, "-g"))
+    .On("fission", "enable -g -gsplit-dwarf",
+        ArgumentParser::Set("0", "1"),
+        ArgumentParser::JoinTo("cflags", {}, "-g -gsplit-dwarf"),
+        ArgumentParser::JoinTo("cxxflags", {}, "-g -gsplit-dwarf"))
+    .On("dwp", "package split debug info", ArgumentParser::Set("", "dwp"))
     .On("release", "enable -DNDEBUG",
         ArgumentParser::JoinTo("cflags", {}, "-DNDEBUG"),
         ArgumentParser::JoinTo("cxxflags", {}, "-DNDEBUG"))
@@ -58,7 +85,12 @@ auto MakeParser() -> ArgumentParser {
 #else
         ArgumentParser::JoinTo("ldflags", {}, "-shared"))
 #endif
-    .On("lto", "enable -flto", ArgumentParser::JoinTo("ldflags", {}, "-flto"))
+    .On("lto", "enable -flto",
+        ArgumentParser::JoinTo("cflags", {}, "-flto"),
+        ArgumentParser::JoinTo("cxxflags", {}, "-flto"),
+        ArgumentParser::JoinTo("ldflags", {}, "-flto"))
+    .On("thinlto", "enable -flto=thin with a cache and parallel backends", ArgumentParser::Set("0", "1"))
+    .On("pgo", "set profile-guided optimization phase (generate or use)", ArgumentParser::Set("", ""))
     .On("c89", "enable -std=c89", ArgumentParser::JoinTo("cflags", {}, "-std=c89"))
     .On("c99", "enable -std=c99", ArgumentParser::JoinTo("cflags", {}, "-std=c99"))
     .On("c11", "enable -std=c11", ArgumentParser::JoinTo("cflags", {}, "-std=c11"))
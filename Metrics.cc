@@ -0,0 +1,123 @@
+#include "Metrics.h"
+#include "Json.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+static auto ReuseRate(const BuildMetrics& metrics) -> double {
+  if (metrics.analyzed == 0) {
+    return 0;
+  }
+  return static_cast<double>(metrics.analyzed - metrics.stale) / metrics.analyzed;
+}
+
+static auto CutoffRate(const BuildMetrics& metrics) -> double {
+  if (metrics.stale == 0) {
+    return 0;
+  }
+  return static_cast<double>(metrics.cutoff) / metrics.stale;
+}
+
+static void WriteJson(std::ostream& stream, const BuildMetrics& metrics) {
+  stream
+    << "{\n"
+    << "  \"target\": " << JsonQuote(metrics.target) << ",\n"
+    << "  \"ok\": " << (metrics.ok ? "true" : "false") << ",\n"
+    << "  \"jobs\": " << metrics.jobs << ",\n"
+    << "  \"max_concurrency\": " << metrics.max_concurrency << ",\n"
+    << "  \"files\": {\n"
+    << "    \"discovered\": " << metrics.discovered << ",\n"
+    << "    \"analyzed\": " << metrics.analyzed << ",\n"
+    << "    \"stale\": " << metrics.stale << ",\n"
+    << "    \"compiled\": " << metrics.compiled << ",\n"
+    << "    \"cutoff\": " << metrics.cutoff << ",\n"
+    << "    \"failed\": " << metrics.failed << "\n"
+    << "  },\n"
+    << "  \"reuse_rate\": " << ReuseRate(metrics) << ",\n"
+    << "  \"cutoff_rate\": " << CutoffRate(metrics) << ",\n"
+    << "  \"phases\": {\n"
+    << "    \"walk\": " << metrics.walk << ",\n"
+    << "    \"analyze\": " << metrics.analyze << ",\n"
+    << "    \"compile\": " << metrics.compile << ",\n"
+    << "    \"link\": " << metrics.link << "\n"
+    << "  },\n"
+    << "  \"slowest\": [";
+  for (size_t i = 0; i < metrics.units.size(); ++i) {
+    const auto& [source, seconds] = metrics.units[i];
+    stream
+      << (i == 0 ? "\n" : ",\n")
+      << "    {\"source\": " << JsonQuote(source) << ", \"seconds\": " << seconds << "}";
+  }
+  stream << (metrics.units.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+static void WritePrometheus(std::ostream& stream, const BuildMetrics& metrics) {
+  const auto& target = "target=" + JsonQuote(metrics.target);
+  stream
+    << "# TYPE sb_success gauge\n"
+    << "sb_success{" << target << "} " << (metrics.ok ? 1 : 0) << '\n'
+    << "# TYPE sb_jobs gauge\n"
+    << "sb_jobs{" << target << "} " << metrics.jobs << '\n'
+    << "# TYPE sb_max_concurrency gauge\n"
+    << "sb_max_concurrency{" << target << "} " << metrics.max_concurrency << '\n'
+    << "# TYPE sb_files gauge\n";
+  for (const auto& [state, count] : std::initializer_list<std::pair<const char*, size_t>>{
+         {"discovered", metrics.discovered},
+         {"analyzed", metrics.analyzed},
+         {"stale", metrics.stale},
+         {"compiled", metrics.compiled},
+         {"cutoff", metrics.cutoff},
+         {"failed", metrics.failed}}) {
+    stream << "sb_files{" << target << ",state=\"" << state << "\"} " << count << '\n';
+  }
+  stream
+    << "# TYPE sb_reuse_rate gauge\n"
+    << "sb_reuse_rate{" << target << "} " << ReuseRate(metrics) << '\n'
+    << "# TYPE sb_cutoff_rate gauge\n"
+    << "sb_cutoff_rate{" << target << "} " << CutoffRate(metrics) << '\n'
+    << "# TYPE sb_phase_seconds gauge\n";
+  for (const auto& [phase, seconds] : std::initializer_list<std::pair<const char*, double>>{
+         {"walk", metrics.walk},
+         {"analyze", metrics.analyze},
+         {"compile", metrics.compile},
+         {"link", metrics.link}}) {
+    stream << "sb_phase_seconds{" << target << ",phase=\"" << phase << "\"} " << seconds << '\n';
+  }
+  stream << "# TYPE sb_slowest_unit_seconds gauge\n";
+  for (size_t i = 0; i < metrics.units.size(); ++i) {
+    const auto& [source, seconds] = metrics.units[i];
+    stream
+      << "sb_slowest_unit_seconds{" << target << ",rank=\"" << i + 1
+      << "\",source=" << JsonQuote(source) << "} " << seconds << '\n';
+  }
+}
+
+auto WriteMetrics(const std::string& path, BuildMetrics metrics, size_t top) -> bool {
+  std::sort(metrics.units.begin(), metrics.units.end(), [](const auto& a, const auto& b) {
+    return a.second > b.second;
+  });
+  if (metrics.units.size() > top) {
+    metrics.units.resize(top);
+  }
+  const auto& temp = path + ".tmp";
+  {
+    std::ofstream stream(temp, std::ios::trunc);
+    if (!stream) {
+      return false;
+    }
+    stream << std::setprecision(6);
+    if (std::filesystem::path(path).extension() == ".prom") {
+      WritePrometheus(stream, metrics);
+    } else {
+      WriteJson(stream, metrics);
+    }
+    if (!stream.flush()) {
+      return false;
+    }
+  }
+  std::error_code err;
+  std::filesystem::rename(temp, path, err);
+  return !err;
+}
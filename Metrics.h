@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BuildMetrics {
+  std::string target;
+  bool ok = true;
+  size_t jobs = 0;
+  size_t max_concurrency = 0;
+
+  size_t discovered = 0;
+  size_t analyzed = 0;
+  size_t stale = 0;
+  size_t compiled = 0;
+  size_t cutoff = 0;
+  size_t failed = 0;
+
+  double walk = 0;
+  double analyze = 0;
+  double compile = 0;
+  double link = 0;
+
+  // compile time of each source built in this run
+  std::vector<std::pair<std::string, double>> units;
+};
+
+// Writes Prometheus textfile format for "*.prom" paths, JSON otherwise.
+auto WriteMetrics(const std::string& path, BuildMetrics metrics, size_t top) -> bool;
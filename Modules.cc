@@ -0,0 +1,211 @@
+#include "Modules.h"
+#include "Json.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <regex>
+#include <sstream>
+
+static auto ParseP1689(const std::string& path) -> std::optional<ModuleScan> {
+  const auto& json = JsonValue::ParseFile(path);
+  if (!json) {
+    return std::nullopt;
+  }
+  const auto* rules = json->Find("rules");
+  if (rules == nullptr || rules->AsArray().empty()) {
+    return std::nullopt;
+  }
+  const auto& rule = rules->AsArray().front();
+  ModuleScan scan;
+  if (const auto* provides = rule.Find("provides")) {
+    for (const auto& item : provides->AsArray()) {
+      if (const auto* name = item.Find("logical-name")) {
+        scan.provides = name->AsString();
+        break;
+      }
+    }
+  }
+  if (const auto* imports = rule.Find("requires")) {
+    for (const auto& item : imports->AsArray()) {
+      if (const auto* name = item.Find("logical-name")) {
+        scan.imports.push_back(name->AsString());
+      }
+    }
+  }
+  return scan;
+}
+
+// "/usr/bin/clang++-17" => "/usr/bin/clang-scan-deps-17"
+static auto ScanDepsFor(const std::string& compiler) -> std::string {
+  auto path = std::filesystem::path(compiler);
+  auto name = path.filename().string();
+  for (const auto* driver : {"clang++", "clang"}) {
+    const auto pos = name.find(driver);
+    if (pos != std::string::npos) {
+      name.replace(pos, std::string(driver).size(), "clang-scan-deps");
+      return path.replace_filename(name).string();
+    }
+  }
+  return "clang-scan-deps";
+}
+
+static auto ScanText(const std::string& source) -> ModuleScan {
+  static const std::regex kDeclaration(R"(^\s*(export\s+)?(module|import)\s+([A-Za-z_][\w.]*)?(:[A-Za-z_][\w.]*)?\s*;)");
+  std::ifstream stream(source);
+  ModuleScan scan;
+  std::string module;
+  for (std::string line; std::getline(stream, line);) {
+    std::smatch match;
+    if (!std::regex_search(line, match, kDeclaration)) {
+      continue;
+    }
+    const auto& name = match[3].str();
+    const auto& partition = match[4].str();
+    if (match[2] == "module") {
+      if (name.empty()) {
+        // global module fragment or private fragment
+        continue;
+      }
+      module = name;
+      if (match[1].matched || !partition.empty()) {
+        scan.provides = name + partition;
+      } else {
+        // implementation units implicitly import their interface
+        scan.imports.push_back(name);
+      }
+    } else if (!name.empty()) {
+      scan.imports.push_back(name + partition);
+    } else if (!partition.empty() && !module.empty()) {
+      scan.imports.push_back(module + partition);
+    }
+  }
+  return scan;
+}
+
+auto ScanModules(
+  CompilerKind kind,
+  const std::string& compiler,
+  const std::string& flags,
+  const std::string& source,
+  const std::string& output) -> ModuleScan {
+  const auto& ddi = output + ".ddi";
+  std::string command;
+  if (kind == CompilerKind::Clang) {
+    command = JoinStrings({ScanDepsFor(compiler), "-format=p1689 --", compiler, flags, "-x c++ -c", source, "-o", output, ">", ddi});
+  } else if (kind == CompilerKind::Gcc) {
+    command = JoinStrings({
+      compiler, flags, "-fmodules-ts -E -MM -MF /dev/null -x c++", source, "-o /dev/null",
+      "-fdeps-format=p1689r5", "-fdeps-file=" + ddi, "-fdeps-target=" + output});
+  }
+  std::optional<ModuleScan> scan;
+  if (!command.empty() && RunProcess(command + " 2>/dev/null")) {
+    scan = ParseP1689(ddi);
+  }
+  std::error_code err;
+  std::filesystem::remove(ddi, err);
+  return scan ? *scan : ScanText(source);
+}
+
+auto ModuleInterfacePath(CompilerKind kind, const std::string& workdir, const std::string& name) -> std::string {
+  auto filename = name;
+  std::replace(filename.begin(), filename.end(), ':', '-');
+  filename += kind == CompilerKind::Clang ? ".pcm" : ".gcm";
+  return (std::filesystem::path(workdir) / filename).string();
+}
+
+auto ModuleMapperPath(const std::string& workdir) -> std::string {
+  return (std::filesystem::path(workdir) / "module.map").string();
+}
+
+auto ModuleFlags(CompilerKind kind, const std::string& workdir) -> std::string {
+  if (kind == CompilerKind::Clang) {
+    return "-fprebuilt-module-path=" + workdir;
+  }
+  return "-fmodules-ts -fmodule-mapper=" + ModuleMapperPath(workdir);
+}
+
+auto ImportedModuleFlag(CompilerKind kind, const std::string& name, const std::string& interface) -> std::string {
+  if (kind == CompilerKind::Clang) {
+    return "-fmodule-file=" + name + "=" + interface;
+  }
+  return {};
+}
+
+auto PlanModules(const std::vector<SourceFile>& files) -> ModulePlan {
+  ModulePlan plan;
+  std::map<std::string, size_t> providers;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto& module = files[i].module;
+    if (module.empty()) {
+      continue;
+    }
+    const auto& [iter, inserted] = providers.emplace(module, i);
+    if (!inserted) {
+      plan.ok = false;
+      plan.error = "module " + module + " is provided by both " + files[iter->second].source + " and " + files[i].source;
+      return plan;
+    }
+  }
+  plan.providers.resize(files.size());
+  std::vector<std::vector<size_t>> importers(files.size());
+  std::vector<size_t> waiting(files.size(), 0);
+  for (size_t i = 0; i < files.size(); ++i) {
+    for (const auto& name : files[i].imports) {
+      const auto& iter = providers.find(name);
+      if (iter == providers.end()) {
+        plan.external.push_back(name);
+        continue;
+      }
+      if (iter->second == i) {
+        continue;
+      }
+      plan.providers[i].push_back(iter->second);
+      importers[iter->second].push_back(i);
+      ++waiting[i];
+    }
+  }
+  SortStrings(plan.external);
+  plan.external.erase(std::unique(plan.external.begin(), plan.external.end()), plan.external.end());
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (waiting[i] == 0) {
+      plan.order.push_back(i);
+    }
+  }
+  for (size_t next = 0; next < plan.order.size(); ++next) {
+    for (const auto importer : importers[plan.order[next]]) {
+      if (--waiting[importer] == 0) {
+        plan.order.push_back(importer);
+      }
+    }
+  }
+  if (plan.order.size() != files.size()) {
+    const auto& iter = std::find_if(waiting.begin(), waiting.end(), [](auto count) { return count > 0; });
+    plan.ok = false;
+    plan.error = "module import cycle involving " + files[iter - waiting.begin()].source;
+  }
+  return plan;
+}
+
+auto WriteModuleMapper(
+  const std::string& workdir,
+  const std::map<std::string, std::string>& interfaces) -> bool {
+  std::ostringstream content;
+  for (const auto& [name, interface] : interfaces) {
+    content << name << ' ' << std::filesystem::absolute(interface).string() << '\n';
+  }
+  const auto& path = ModuleMapperPath(workdir);
+  {
+    std::ifstream stream(path);
+    std::ostringstream existing;
+    existing << stream.rdbuf();
+    if (stream && existing.str() == content.str()) {
+      return true;
+    }
+  }
+  std::ofstream stream(path, std::ios::trunc);
+  stream << content.str();
+  return static_cast<bool>(stream.flush());
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "SourceAnalyzer.h"
+#include "Toolchain.h"
+
+struct ModuleScan {
+  // logical name of the module or partition this unit provides, if any
+  std::string provides;
+  std::vector<std::string> imports;
+};
+
+// Asks the toolchain for P1689 dependency info (clang-scan-deps, or gcc
+// -fdeps-format) and falls back to reading module declarations from the
+// source text when it is unavailable.
+auto ScanModules(
+  CompilerKind kind,
+  const std::string& compiler,
+  const std::string& flags,
+  const std::string& source,
+  const std::string& output) -> ModuleScan;
+
+// Where the interface of `name` is cached, e.g. "workdir/m-part.pcm" for m:part.
+auto ModuleInterfacePath(CompilerKind kind, const std::string& workdir, const std::string& name) -> std::string;
+auto ModuleMapperPath(const std::string& workdir) -> std::string;
+auto ModuleFlags(CompilerKind kind, const std::string& workdir) -> std::string;
+// Points an importer at an interface cached outside its own workdir, e.g. one
+// provided by another target; empty where the mapper already does.
+auto ImportedModuleFlag(CompilerKind kind, const std::string& name, const std::string& interface) -> std::string;
+
+struct ModulePlan {
+  bool ok = true;
+  std::string error;
+  // indexes into files, every provider ahead of its importers
+  std::vector<size_t> order;
+  // per file, the files providing its imports
+  std::vector<std::vector<size_t>> providers;
+  // imports that no file provides, e.g. std
+  std::vector<std::string> external;
+};
+
+auto PlanModules(const std::vector<SourceFile>& files) -> ModulePlan;
+
+// gcc reads module name to interface mappings from this file, one entry per
+// provided module wherever its interface is cached.
+auto WriteModuleMapper(
+  const std::string& workdir,
+  const std::map<std::string, std::string>& interfaces) -> bool;
@@ -0,0 +1,228 @@
+#include "Ninja.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+// values only treat '$' specially, paths in build lines also ' ' and ':'
+static auto EscapeValue(const std::string& value) -> std::string {
+  std::string result;
+  for (const auto c : value) {
+    if (c == '$') {
+      result += '$';
+    }
+    result += c;
+  }
+  return result;
+}
+
+static auto EscapePath(const std::string& path) -> std::string {
+  std::string result;
+  for (const auto c : path) {
+    if (c == '$' || c == ' ' || c == ':') {
+      result += '$';
+    }
+    result += c;
+  }
+  return result;
+}
+
+static auto EscapePaths(const std::vector<std::string>& paths) -> std::string {
+  std::vector<std::string> escaped;
+  for (const auto& path : paths) {
+    escaped.push_back(EscapePath(path));
+  }
+  return JoinStrings(escaped);
+}
+
+auto ShellQuote(const std::string& arg) -> std::string {
+  const auto plain = !arg.empty() && arg.find_first_not_of(
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-+=/.,:@%") == std::string::npos;
+  if (plain) {
+    return arg;
+  }
+  std::string result = "'";
+  for (const auto c : arg) {
+    if (c == '\'') {
+      result += "'\\''";
+    } else {
+      result += c;
+    }
+  }
+  return result + "'";
+}
+
+static auto SourcesPath(const std::string& path) -> std::string {
+  return path + ".sources";
+}
+
+auto WriteNinjaSources(const std::string& path, const std::vector<std::string>& sources) -> bool {
+  return WriteFileIfChanged(SourcesPath(path), JoinStrings(sources, "\n") + "\n");
+}
+
+auto DescribeBuild(
+  BuildContext& build,
+  FastLinkers& fast_linkers,
+  const std::vector<std::vector<size_t>>& providers,
+  const std::string& stamp,
+  bool without_link) -> NinjaFile {
+  const auto& files = build.files;
+  const auto& targets = build.project.targets;
+  auto& linkers = build.linkers;
+  NinjaFile ninja;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto& file = files[i];
+    if (!file) {
+      continue;
+    }
+    NinjaCompile compile;
+    compile.source = file.source;
+    compile.output = file.output;
+    compile.command = file.rebuild;
+    // -MM scanning of assembly and module units is all there is
+    const auto assembly = file.linker.priority == Linker::ForAsm(file.linker.command).priority;
+    const auto modular = !file.module.empty() || !file.imports.empty();
+    compile.depfile = !assembly && !modular;
+    if (!compile.depfile) {
+      std::copy_if(file.dependencies.begin(), file.dependencies.end(), std::back_inserter(compile.inputs), [&](const auto& path) {
+        return std::filesystem::path(path).lexically_normal() != std::filesystem::path(file.source).lexically_normal();
+      });
+    }
+    for (const auto provider : providers[i]) {
+      compile.inputs.push_back(files[provider].output);
+    }
+    if (!stamp.empty()) {
+      compile.inputs.push_back(stamp);
+    }
+    ninja.compiles.push_back(std::move(compile));
+  }
+  for (size_t t = 0; t < targets.size() && !without_link; ++t) {
+    const auto& target = targets[t];
+    for (const auto dependency : target.dependencies) {
+      if (linkers[dependency] > linkers[t]) {
+        linkers[t] = linkers[dependency];
+      }
+    }
+    NinjaLink link;
+    link.output = target.output;
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (build.owners[i] == t && files[i]) {
+        link.objects.push_back(files[i].output);
+      }
+    }
+    link.libraries = LinkInputs(build.project, t);
+    link.archive = target.type == TargetType::Static;
+    if (link.archive) {
+      link.tool = target.args.at("ar");
+    } else {
+      link.tool = linkers[t].command;
+      link.flags = fast_linkers.Flags(linkers[t], target.args.at("ldflags")).first;
+      if (link.tool.empty()) {
+        ninja.ok = false;
+        ninja.error = "undetermined linker";
+        return ninja;
+      }
+      if (target.args.at("fission") == "1" && ProbeLinkerFlag(link.tool, "-Wl,--gdb-index")) {
+        link.flags = JoinStrings({link.flags, "-Wl,--gdb-index"});
+      }
+    }
+    ninja.links.push_back(std::move(link));
+  }
+  return ninja;
+}
+
+auto WriteNinja(const std::string& path, const NinjaFile& ninja) -> bool {
+  const auto& temp = path + ".tmp";
+  {
+    std::ofstream stream(temp);
+    if (!stream) {
+      return false;
+    }
+    stream
+      << "# generated by sb, rerun sb rather than editing this file\n"
+      << "ninja_required_version = 1.3\n"
+      << "\n"
+      << "pool jobs\n"
+      << "  depth = " << ninja.jobs << "\n"
+      << "\n"
+      << "rule compile\n"
+      << "  command = $command -MMD -MF $out.d\n"
+      << "  depfile = $out.d\n"
+      << "  deps = gcc\n"
+      << "  description = $in => $out\n"
+      << "  pool = jobs\n"
+      << "\n"
+      << "rule compile_scanned\n"
+      << "  command = $command\n"
+      << "  description = $in => $out\n"
+      << "  pool = jobs\n"
+      << "\n"
+      << "rule link\n"
+      << "  command = $tool $flags -o $out @$out.rsp $libraries\n"
+      << "  rspfile = $out.rsp\n"
+      << "  rspfile_content = $in\n"
+      << "  description = $out\n"
+      << "  pool = jobs\n"
+      << "\n"
+      << "rule archive\n"
+      << "  command = rm -f $out && $tool rcs $out @$out.rsp\n"
+      << "  rspfile = $out.rsp\n"
+      << "  rspfile_content = $in\n"
+      << "  description = $out\n"
+      << "  pool = jobs\n"
+      << "\n"
+      << "rule list_sources\n"
+      << "  command = " << EscapeValue(ninja.list_sources) << "\n"
+      << "  description = checking sources\n"
+      << "  restat = 1\n"
+      << "\n"
+      << "rule regenerate\n"
+      << "  command = " << EscapeValue(ninja.regenerate) << "\n"
+      << "  description = regenerating $out\n"
+      << "  generator = 1\n"
+      << "\n"
+      // an input-less phony is always dirty, restat keeps an unchanged list quiet
+      << "build " << EscapePath(path + ".always") << ": phony\n"
+      << "build " << EscapePath(SourcesPath(path)) << ": list_sources | " << EscapePath(path + ".always") << "\n"
+      << "build " << EscapePath(path) << ": regenerate " << EscapePath(SourcesPath(path));
+    if (!ninja.watched.empty()) {
+      stream << " | " << EscapePaths(ninja.watched);
+    }
+    stream << "\n\n";
+    for (const auto& compile : ninja.compiles) {
+      stream
+        << "build " << EscapePath(compile.output) << ": "
+        << (compile.depfile ? "compile " : "compile_scanned ") << EscapePath(compile.source);
+      if (!compile.inputs.empty()) {
+        stream << " | " << EscapePaths(compile.inputs);
+      }
+      stream << "\n  command = " << EscapeValue(compile.command) << "\n";
+    }
+    std::vector<std::string> outputs;
+    for (const auto& link : ninja.links) {
+      stream
+        << "\n"
+        << "build " << EscapePath(link.output) << ": " << (link.archive ? "archive " : "link ")
+        << EscapePaths(link.objects);
+      if (!link.libraries.empty()) {
+        stream << " | " << EscapePaths(link.libraries);
+      }
+      stream
+        << "\n  tool = " << EscapeValue(link.tool) << "\n"
+        << "  flags = " << EscapeValue(link.flags) << "\n"
+        << "  libraries = " << EscapeValue(JoinStrings(link.libraries)) << "\n";
+      outputs.push_back(link.output);
+    }
+    if (!outputs.empty()) {
+      stream << "\ndefault " << EscapePaths(outputs) << "\n";
+    }
+    if (!stream.flush()) {
+      return false;
+    }
+  }
+  std::error_code err;
+  std::filesystem::rename(temp, path, err);
+  return !err;
+}
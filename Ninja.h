@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Build.h"
+#include "Link.h"
+
+struct NinjaCompile {
+  std::string source;
+  std::string output;
+  std::string command;
+  // gcc-style depfiles from -MMD; otherwise `inputs` are the whole dependency list
+  bool depfile = false;
+  std::vector<std::string> inputs;
+};
+
+struct NinjaLink {
+  std::string output;
+  std::vector<std::string> objects;
+  // outputs of other targets, linked after the objects
+  std::vector<std::string> libraries;
+  bool archive = false;
+  // linker or archiver and, for linkers, its flags
+  std::string tool;
+  std::string flags;
+};
+
+struct NinjaFile {
+  bool ok = true;
+  std::string error;
+  size_t jobs = 1;
+  std::vector<NinjaCompile> compiles;
+  std::vector<NinjaLink> links;
+  // reruns sb whenever one of `watched` or the list of sources changes
+  std::string regenerate;
+  std::vector<std::string> watched;
+  // lists the sources again on every ninja run, see WriteNinjaSources
+  std::string list_sources;
+};
+
+// Describes the analyzed `build`: a compile per source, after the module
+// interfaces in `providers` and `stamp` if any, and unless `without_link` a
+// link per target.
+auto DescribeBuild(
+  BuildContext& build,
+  FastLinkers& fast_linkers,
+  const std::vector<std::vector<size_t>>& providers,
+  const std::string& stamp,
+  bool without_link) -> NinjaFile;
+
+// Writes `ninja` as a build.ninja at `path`; paths stay as given, so ninja has
+// to run from the directory sb ran in.
+auto WriteNinja(const std::string& path, const NinjaFile& ninja) -> bool;
+
+// Stores the source list next to the build.ninja at `path`, touching the file
+// only when the list changed, so that regeneration follows added and removed
+// sources wherever they live.
+auto WriteNinjaSources(const std::string& path, const std::vector<std::string>& sources) -> bool;
+
+// Quotes `arg` for /bin/sh.
+auto ShellQuote(const std::string& arg) -> std::string;
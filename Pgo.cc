@@ -0,0 +1,146 @@
+#include "Pgo.h"
+#include "Toolchain.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static void AddFlags(std::map<std::string, std::string>& args, const std::string& flags) {
+  for (const auto& key : {"cflags", "cxxflags", "ldflags"}) {
+    auto& value = args.at(key);
+    value = JoinStrings({value, flags});
+  }
+}
+
+static auto ListFiles(const fs::path& dir, const std::string& extension) -> std::vector<std::string> {
+  std::vector<std::string> files;
+  std::error_code err;
+  for (const auto& entry : fs::directory_iterator(dir, err)) {
+    if (entry.is_regular_file() && entry.path().extension() == extension) {
+      files.push_back(entry.path().string());
+    }
+  }
+  SortStrings(files);
+  return files;
+}
+
+// gcc names each .gcda after the absolute object path with '/' turned into '#'
+static auto MangleGcovPath(const fs::path& path) -> std::string {
+  auto mangled = path.lexically_normal().string();
+  std::replace(mangled.begin(), mangled.end(), '/', '#');
+  return mangled;
+}
+
+static auto MergeClangProfiles(const std::string& tool, const fs::path& profdir, std::vector<std::string>& inputs) -> std::string {
+  const auto& profdata = (profdir / "default.profdata").string();
+  const auto& raws = ListFiles(profdir, ".profraw");
+  if (raws.empty() && !fs::exists(profdata)) {
+    return "no .profraw files in " + profdir.string();
+  }
+  const auto stale = !fs::exists(profdata) || std::any_of(raws.begin(), raws.end(), [&](const auto& raw) {
+    return IsNewer(raw, profdata);
+  });
+  if (stale) {
+    const auto& command = JoinStrings({tool, "merge", "-output=" + profdata, JoinStrings(raws)});
+    if (std::system(command.c_str()) != 0) {
+      return "failed to merge profiles: " + command;
+    }
+  }
+  inputs.push_back(profdata);
+  return {};
+}
+
+static auto MergeGccProfiles(const fs::path& profdir, const fs::path& generate_dir, const fs::path& use_dir, std::vector<std::string>& inputs) -> std::string {
+  const auto& from = MangleGcovPath(generate_dir) + '#';
+  const auto& to = MangleGcovPath(use_dir) + '#';
+  const auto& mapped = profdir / "use";
+  std::error_code err;
+  fs::create_directories(mapped, err);
+  for (const auto& gcda : ListFiles(profdir, ".gcda")) {
+    const auto& name = fs::path(gcda).filename().string();
+    if (name.compare(0, from.size(), from) != 0) {
+      continue;
+    }
+    const auto& target = (mapped / (to + name.substr(from.size()))).string();
+    if (!fs::exists(target) || IsNewer(gcda, target)) {
+      fs::copy_file(gcda, target, fs::copy_options::overwrite_existing, err);
+      if (err) {
+        return "failed to copy " + gcda + ": " + err.message();
+      }
+    }
+    inputs.push_back(target);
+  }
+  if (inputs.empty()) {
+    return "no .gcda files in " + profdir.string();
+  }
+  return {};
+}
+
+static auto UpdateStamp(const fs::path& stamp, const std::vector<std::string>& inputs) -> bool {
+  auto hash = kHashSeed;
+  for (const auto& input : inputs) {
+    hash = HashBytes(fs::path(input).filename().string(), hash);
+    const auto& file_hash = HashFile(input, hash);
+    if (!file_hash) {
+      return false;
+    }
+    hash = *file_hash;
+  }
+  const auto& text = std::to_string(hash);
+  {
+    std::ifstream stream(stamp);
+    std::string previous;
+    if (stream && std::getline(stream, previous) && previous == text) {
+      return true;
+    }
+  }
+  std::ofstream stream(stamp, std::ios::trunc);
+  stream << text << '\n';
+  return static_cast<bool>(stream);
+}
+
+auto SetupPgo(std::map<std::string, std::string>& args, bool compiling) -> PgoSetup {
+  const auto& mode = args.at("pgo");
+  if (mode.empty()) {
+    return {};
+  }
+  const auto& workdir = fs::absolute(args.at("workdir")).lexically_normal();
+  const auto& generate_dir = workdir / "pgo-generate";
+  const auto& profdir = workdir / "pgo-profile";
+  if (mode == "generate") {
+    args.at("workdir") = (fs::path(args.at("workdir")) / "pgo-generate").string();
+    AddFlags(args, "-fprofile-generate=" + profdir.string());
+    return {};
+  }
+  if (mode != "use") {
+    return {false, "invalid pgo mode: " + mode, {}};
+  }
+  if (!compiling) {
+    return {};
+  }
+  const auto kind = ProbeCompilerKind(args.at("cxx"));
+  std::vector<std::string> inputs;
+  std::string error;
+  if (kind == CompilerKind::Clang) {
+    error = MergeClangProfiles(args.at("profdata"), profdir, inputs);
+  } else {
+    error = MergeGccProfiles(profdir, generate_dir, workdir, inputs);
+  }
+  if (!error.empty()) {
+    return {false, error, {}};
+  }
+  const auto& flags = kind == CompilerKind::Clang
+                        ? "-fprofile-use=" + inputs.front()
+                        : "-fprofile-use=" + (profdir / "use").string() + " -fprofile-correction -Wno-missing-profile";
+  const auto& stamp = profdir / "profile.stamp";
+  if (!UpdateStamp(stamp, inputs)) {
+    return {false, "failed to update " + stamp.string(), {}};
+  }
+  AddFlags(args, flags);
+  return {true, {}, stamp.string()};
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+struct PgoSetup {
+  bool ok = true;
+  std::string error;
+  // a file whose mtime changes only when the merged profile does
+  std::string stamp;
+};
+
+// Adjusts flags and workdir for pgo=generate|use. The instrumented variant is
+// built under <workdir>/pgo-generate, profiles land in <workdir>/pgo-profile,
+// and the optimized variant is built in <workdir> itself. Profiles are only
+// merged when `compiling`, other runs just get the workdir.
+auto SetupPgo(std::map<std::string, std::string>& args, bool compiling) -> PgoSetup;
@@ -0,0 +1,365 @@
+#include "ProcessManager.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#define SB_HAVE_KQUEUE
+#endif
+
+// Waits for the wake pipe, jobserver tokens and child exits at once. Children
+// it cannot watch are left to the caller, which polls them with WNOHANG.
+class ProcessManager::Poller {
+ public:
+  enum class Kind : uint32_t {
+    Wake,
+    Token,
+    Child,
+  };
+
+  struct Event {
+    Kind kind;
+    int pid;
+  };
+
+#if defined(__linux__)
+  explicit Poller(int wake_fd)
+    : fd_(::epoll_create1(EPOLL_CLOEXEC)) {
+    Add(wake_fd, EPOLLIN, Kind::Wake, 0);
+  }
+
+  ~Poller() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // Sets `fd` to a descriptor to release with Forget().
+  auto WatchChild(int pid, int& fd) -> bool {
+#ifdef SYS_pidfd_open
+    fd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+    if (fd >= 0 && Add(fd, EPOLLIN, Kind::Child, pid)) {
+      return true;
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+#endif
+    fd = -1;
+    return false;
+  }
+
+  void Forget(int fd) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  void WatchToken(int fd) {
+    if (fd < 0) {
+      return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = Pack(Kind::Token, 0);
+    if (::epoll_ctl(fd_, token_fd_ == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) == 0) {
+      token_fd_ = fd;
+    }
+  }
+
+  auto Wait(int timeout) -> std::vector<Event> {
+    std::vector<epoll_event> events(64);
+    const auto n = ::epoll_wait(fd_, events.data(), events.size(), timeout);
+    std::vector<Event> result;
+    for (int i = 0; i < n; ++i) {
+      const auto data = events[i].data.u64;
+      result.push_back({static_cast<Kind>(data >> 32), static_cast<int>(data & 0xffffffff)});
+    }
+    return result;
+  }
+
+ private:
+  static auto Pack(Kind kind, int pid) -> uint64_t {
+    return (static_cast<uint64_t>(kind) << 32) | static_cast<uint32_t>(pid);
+  }
+
+  auto Add(int fd, uint32_t events, Kind kind, int pid) -> bool {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = Pack(kind, pid);
+    return ::epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+
+ private:
+  int fd_ = -1;
+  int token_fd_ = -1;
+#elif defined(SB_HAVE_KQUEUE)
+  explicit Poller(int wake_fd)
+    : fd_(::kqueue()) {
+    Add(wake_fd, EVFILT_READ, EV_ADD, 0, Kind::Wake);
+  }
+
+  ~Poller() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  auto WatchChild(int pid, int& fd) -> bool {
+    fd = -1;
+    return Add(pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, Kind::Child);
+  }
+
+  void Forget(int /*fd*/) {
+  }
+
+  void WatchToken(int fd) {
+    if (fd >= 0) {
+      Add(fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, Kind::Token);
+    }
+  }
+
+  auto Wait(int timeout) -> std::vector<Event> {
+    std::vector<struct kevent> events(64);
+    timespec spec{timeout / 1000, (timeout % 1000) * 1000000L};
+    const auto n = ::kevent(fd_, nullptr, 0, events.data(), events.size(), timeout < 0 ? nullptr : &spec);
+    std::vector<Event> result;
+    for (int i = 0; i < n; ++i) {
+      const auto kind = static_cast<Kind>(reinterpret_cast<uintptr_t>(events[i].udata));
+      result.push_back({kind, kind == Kind::Child ? static_cast<int>(events[i].ident) : 0});
+    }
+    return result;
+  }
+
+ private:
+  auto Add(uintptr_t ident, short filter, unsigned short flags, unsigned int fflags, Kind kind) -> bool {
+    struct kevent event {};
+    EV_SET(&event, ident, filter, flags, fflags, 0, reinterpret_cast<void*>(static_cast<uintptr_t>(kind)));
+    return ::kevent(fd_, &event, 1, nullptr, 0, nullptr) == 0;
+  }
+
+ private:
+  int fd_ = -1;
+#else
+  explicit Poller(int wake_fd)
+    : wake_fd_(wake_fd) {
+  }
+
+  auto WatchChild(int /*pid*/, int& fd) -> bool {
+    fd = -1;
+    return false;
+  }
+
+  void Forget(int /*fd*/) {
+  }
+
+  void WatchToken(int fd) {
+    token_fd_ = fd;
+  }
+
+  auto Wait(int timeout) -> std::vector<Event> {
+    pollfd fds[2] = {{wake_fd_, POLLIN, 0}, {token_fd_, POLLIN, 0}};
+    const auto n = ::poll(fds, token_fd_ >= 0 ? 2 : 1, timeout);
+    std::vector<Event> result;
+    if (n > 0 && (fds[0].revents & POLLIN) != 0) {
+      result.push_back({Kind::Wake, 0});
+    }
+    if (n > 0 && token_fd_ >= 0 && (fds[1].revents & POLLIN) != 0) {
+      token_fd_ = -1;
+      result.push_back({Kind::Token, 0});
+    }
+    return result;
+  }
+
+ private:
+  int wake_fd_ = -1;
+  int token_fd_ = -1;
+#endif
+};
+
+ProcessManager::ProcessManager(cab::Executor& executor, Jobserver& jobserver, size_t limit)
+  : executor_(executor),
+    jobserver_(jobserver),
+    limit_(std::max<size_t>(1, limit)),
+    throttle_(limit_) {
+  if (::pipe(wake_fds_) == 0) {
+    for (const auto fd : wake_fds_) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+  thread_ = std::thread([this]() { Loop(); });
+}
+
+ProcessManager::~ProcessManager() {
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    stopping_ = true;
+  }
+  Wake();
+  thread_.join();
+  for (const auto fd : wake_fds_) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+void ProcessManager::Spawn(std::string command, Callback callback, double timeout, double priority, bool throttled) {
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto& queue = throttled ? throttled_pending_ : pending_;
+    queue.push_back({std::move(command), std::move(callback), timeout, priority, throttled, sequence_++});
+    std::push_heap(queue.begin(), queue.end());
+  }
+  Wake();
+}
+
+void ProcessManager::Throttle(size_t limit) {
+  throttle_ = std::max<size_t>(1, limit);
+  Wake();
+}
+
+void ProcessManager::Wake() {
+  const char byte = 0;
+  while (::write(wake_fds_[1], &byte, 1) < 0 && errno == EINTR) {
+  }
+}
+
+void ProcessManager::Loop() {
+  Poller poller(wake_fds_[0]);
+  while (true) {
+    StartPending(poller);
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (stopping_ && pending_.empty() && throttled_pending_.empty() && children_.empty()) {
+        return;
+      }
+    }
+    const auto unwatched = std::any_of(children_.begin(), children_.end(), [](const auto& entry) {
+      return !entry.second.watched;
+    });
+    auto timeout = KillOverdue();
+    if (unwatched && (timeout < 0 || timeout > 10)) {
+      timeout = 10;
+    }
+    for (const auto& event : poller.Wait(timeout)) {
+      if (event.kind == Poller::Kind::Wake) {
+        char buffer[64];
+        while (::read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {
+        }
+      } else if (event.kind == Poller::Kind::Child) {
+        Reap(poller, event.pid);
+      }
+    }
+    if (unwatched) {
+      std::vector<int> pids;
+      for (const auto& [pid, child] : children_) {
+        if (!child.watched) {
+          pids.push_back(pid);
+        }
+      }
+      for (const auto pid : pids) {
+        Reap(poller, pid);
+      }
+    }
+  }
+}
+
+void ProcessManager::StartPending(Poller& poller) {
+  while (children_.size() < limit_) {
+    // the most urgent request that may start, throttled ones only below the cap
+    const auto pick = [this]() -> std::vector<Request>* {
+      const auto throttled = !throttled_pending_.empty() && throttled_running_ < throttle_;
+      if (pending_.empty()) {
+        return throttled ? &throttled_pending_ : nullptr;
+      }
+      return throttled && pending_.front() < throttled_pending_.front() ? &throttled_pending_ : &pending_;
+    };
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (!pick()) {
+        return;
+      }
+    }
+    if (!jobserver_.TryAcquire()) {
+      poller.WatchToken(jobserver_.PollFd());
+      return;
+    }
+    Request request;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      auto& queue = *pick();
+      std::pop_heap(queue.begin(), queue.end());
+      request = std::move(queue.back());
+      queue.pop_back();
+    }
+    Child child;
+    const auto pid = SpawnProcess(request.command);
+    if (pid < 0) {
+      jobserver_.Release();
+      executor_.Push([callback = std::move(request.callback)]() { callback(ProcessResult{}); });
+      continue;
+    }
+    child.callback = std::move(request.callback);
+    child.timeout = request.timeout;
+    child.throttled = request.throttled;
+    throttled_running_ += request.throttled;
+    child.watched = poller.WatchChild(pid, child.fd);
+    children_.emplace(pid, std::move(child));
+    if (children_.size() > max_running_) {
+      max_running_ = children_.size();
+    }
+  }
+}
+
+auto ProcessManager::KillOverdue() -> int {
+  int next = -1;
+  for (auto& [pid, child] : children_) {
+    if (child.timeout <= 0 || child.timed_out) {
+      continue;
+    }
+    const auto left = child.timeout - child.watch.Elapsed();
+    if (left <= 0) {
+      ::kill(pid, SIGKILL);
+      child.timed_out = true;
+      continue;
+    }
+    const auto ms = static_cast<int>(left * 1000) + 1;
+    if (next < 0 || ms < next) {
+      next = ms;
+    }
+  }
+  return next;
+}
+
+void ProcessManager::Reap(Poller& poller, int pid) {
+  const auto& iter = children_.find(pid);
+  if (iter == children_.end()) {
+    return;
+  }
+  auto result = ReapProcess(pid, false);
+  if (!result) {
+    return;
+  }
+  auto& child = iter->second;
+  result->wall = child.watch.Elapsed();
+  result->timed_out = child.timed_out;
+  poller.Forget(child.fd);
+  auto callback = std::move(child.callback);
+  throttled_running_ -= child.throttled;
+  children_.erase(iter);
+  jobserver_.Release();
+  executor_.Push([callback = std::move(callback), result = *result]() { callback(result); });
+}
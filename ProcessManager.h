@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cab/Executor.h"
+
+#include "Jobserver.h"
+#include "Utils.h"
+
+// Spawns shell commands without blocking the caller and reaps them on a
+// single reactor thread, through pidfd and epoll on Linux or EVFILT_PROC on
+// BSD and macOS. Up to `limit` children run at once, each holding a
+// jobserver token, however many executor threads there are. Completion
+// callbacks run on the executor.
+class ProcessManager {
+ public:
+  using Callback = std::function<void(const ProcessResult&)>;
+
+ public:
+  ProcessManager(cab::Executor& executor, Jobserver& jobserver, size_t limit);
+  ProcessManager(const ProcessManager&) = delete;
+  ProcessManager(ProcessManager&&) = delete;
+  auto operator=(const ProcessManager&) -> ProcessManager& = delete;
+  auto operator=(ProcessManager&&) -> ProcessManager& = delete;
+  // Waits for every spawned child.
+  ~ProcessManager();
+
+  // A child still running after `timeout` seconds, if positive, is killed
+  // and reported with `timed_out` set. Queued commands with a higher
+  // `priority` start first. `throttled` ones also count against Throttle().
+  void Spawn(std::string command, Callback callback, double timeout = 0, double priority = 0, bool throttled = false);
+
+  // Caps throttled children below `limit`, e.g. the compiles jobs=auto
+  // tunes; those already running beyond a lowered cap are left to finish.
+  void Throttle(size_t limit);
+
+  [[nodiscard]] auto MaxRunning() const -> size_t {
+    return max_running_;
+  }
+
+ private:
+  struct Request {
+    std::string command;
+    Callback callback;
+    double timeout = 0;
+    double priority = 0;
+    bool throttled = false;
+    size_t sequence = 0;
+
+    bool operator<(const Request& that) const {
+      return priority < that.priority || (priority == that.priority && sequence > that.sequence);
+    }
+  };
+
+  struct Child {
+    Callback callback;
+    Stopwatch watch;
+    int fd = -1;
+    bool watched = false;
+    double timeout = 0;
+    bool timed_out = false;
+    bool throttled = false;
+  };
+
+  class Poller;
+
+  void Loop();
+  void StartPending(Poller& poller);
+  // kills overdue children, returns milliseconds until the next deadline or -1
+  auto KillOverdue() -> int;
+  void Reap(Poller& poller, int pid);
+  void Wake();
+
+ private:
+  cab::Executor& executor_;
+  Jobserver& jobserver_;
+  size_t limit_;
+  std::atomic_size_t throttle_;
+  size_t throttled_running_ = 0;
+  std::mutex mutex_;
+  std::vector<Request> pending_;
+  std::vector<Request> throttled_pending_;
+  size_t sequence_ = 0;
+  bool stopping_ = false;
+  std::map<int, Child> children_;
+  std::atomic_size_t max_running_ = 0;
+  int wake_fds_[2] = {-1, -1};
+  std::thread thread_;
+};
@@ -0,0 +1,175 @@
+#include "Project.h"
+#include "Json.h"
+#include "Utils.h"
+
+#include <filesystem>
+#include <functional>
+#include <set>
+
+static auto OutputName(const std::string& name, TargetType type) -> std::string {
+  switch (type) {
+    case TargetType::Static:
+      return "lib" + name + ".a";
+    case TargetType::Shared:
+#ifdef __APPLE__
+      return "lib" + name + ".dylib";
+#else
+      return "lib" + name + ".so";
+#endif
+    default:
+      return name;
+  }
+}
+
+auto MakeSingleProject(const std::map<std::string, std::string>& args, std::vector<std::string> sources) -> Project {
+  Project project;
+  ProjectTarget target;
+  target.name = args.at("target");
+  target.sources = std::move(sources);
+  target.args = args;
+  target.output = (std::filesystem::path(args.at("workdir")) / args.at("target")).string();
+  project.targets.push_back(std::move(target));
+  return project;
+}
+
+auto LoadProject(const std::string& path, const std::map<std::string, std::string>& args) -> Project {
+  Project project;
+  const auto fail = [&](std::string error) {
+    project.ok = false;
+    project.error = path + ": " + std::move(error);
+    project.targets.clear();
+    return project;
+  };
+  const auto& json = JsonValue::ParseFile(path);
+  if (!json) {
+    return fail("invalid json");
+  }
+  const auto* targets = json->Find("targets");
+  if (targets == nullptr || targets->AsArray().empty()) {
+    return fail("no targets");
+  }
+  const auto& base = std::filesystem::path(path).parent_path();
+  std::vector<ProjectTarget> declared;
+  std::vector<std::vector<std::string>> dependency_names;
+  std::map<std::string, size_t> indexes;
+  for (const auto& item : targets->AsArray()) {
+    ProjectTarget target;
+    const auto* name = item.Find("name");
+    if (name == nullptr || name->AsString().empty()) {
+      return fail("target without name");
+    }
+    target.name = name->AsString();
+    if (!indexes.emplace(target.name, declared.size()).second) {
+      return fail("duplicate target " + target.name);
+    }
+    if (const auto* type = item.Find("type")) {
+      if (type->AsString() == "static") {
+        target.type = TargetType::Static;
+      } else if (type->AsString() == "shared") {
+        target.type = TargetType::Shared;
+      } else if (type->AsString() != "executable") {
+        return fail("unknown type " + type->AsString() + " of " + target.name);
+      }
+    }
+    if (const auto* sources = item.Find("sources")) {
+      for (const auto& source : sources->AsArray()) {
+        target.sources.push_back((base / source.AsString()).lexically_normal().string());
+      }
+    }
+    if (target.sources.empty()) {
+      return fail("no sources for " + target.name);
+    }
+    std::vector<std::string> names;
+    if (const auto* deps = item.Find("deps")) {
+      for (const auto& dep : deps->AsArray()) {
+        names.push_back(dep.AsString());
+      }
+    }
+    target.args = args;
+    for (const auto* key : {"cflags", "cxxflags", "asflags", "ldflags"}) {
+      if (const auto* flags = item.Find(key)) {
+        target.args[key] = JoinStrings({target.args[key], flags->AsString()});
+      }
+    }
+    if (target.type == TargetType::Shared) {
+      target.args["cflags"] = JoinStrings({target.args["cflags"], "-fPIC"});
+      target.args["cxxflags"] = JoinStrings({target.args["cxxflags"], "-fPIC"});
+#ifdef __APPLE__
+      target.args["ldflags"] = JoinStrings({target.args["ldflags"], "-dynamiclib"});
+#else
+      target.args["ldflags"] = JoinStrings({target.args["ldflags"], "-shared"});
+#endif
+    }
+    const auto& workdir = std::filesystem::path(args.at("workdir")) / target.name;
+    target.args["workdir"] = workdir.string();
+    target.args["target"] = OutputName(target.name, target.type);
+    target.output = (workdir / target.args["target"]).string();
+    declared.push_back(std::move(target));
+    dependency_names.push_back(std::move(names));
+  }
+
+  // order dependencies first, rejecting cycles
+  std::vector<size_t> order;
+  std::vector<int> marks(declared.size(), 0);
+  std::string error;
+  std::function<bool(size_t)> visit = [&](size_t i) {
+    if (marks[i] == 2) {
+      return true;
+    }
+    if (marks[i] == 1) {
+      error = "dependency cycle through " + declared[i].name;
+      return false;
+    }
+    marks[i] = 1;
+    for (const auto& name : dependency_names[i]) {
+      const auto& iter = indexes.find(name);
+      if (iter == indexes.end()) {
+        error = "unknown dependency " + name + " of " + declared[i].name;
+        return false;
+      }
+      if (!visit(iter->second)) {
+        return false;
+      }
+    }
+    marks[i] = 2;
+    order.push_back(i);
+    return true;
+  };
+  for (size_t i = 0; i < declared.size(); ++i) {
+    if (!visit(i)) {
+      return fail(error);
+    }
+  }
+  std::vector<size_t> positions(declared.size());
+  for (size_t k = 0; k < order.size(); ++k) {
+    positions[order[k]] = k;
+  }
+  for (const auto i : order) {
+    auto& target = declared[i];
+    for (const auto& name : dependency_names[i]) {
+      target.dependencies.push_back(positions[indexes.at(name)]);
+    }
+    project.targets.push_back(std::move(target));
+  }
+  return project;
+}
+
+auto LinkInputs(const Project& project, size_t index) -> std::vector<std::string> {
+  std::set<size_t> reachable;
+  std::vector<size_t> stack{index};
+  while (!stack.empty()) {
+    const auto current = stack.back();
+    stack.pop_back();
+    for (const auto dependency : project.targets[current].dependencies) {
+      if (reachable.insert(dependency).second) {
+        stack.push_back(dependency);
+      }
+    }
+  }
+  // dependents before their dependencies, as static archives need
+  std::vector<std::string> inputs;
+  for (auto iter = reachable.rbegin(); iter != reachable.rend(); ++iter) {
+    inputs.push_back(project.targets[*iter].output);
+  }
+  return inputs;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+enum class TargetType {
+  Executable,
+  Static,
+  Shared,
+};
+
+struct ProjectTarget {
+  std::string name;
+  TargetType type = TargetType::Executable;
+  // files and directories to gather sources from
+  std::vector<std::string> sources;
+  // indexes of the targets this one links against, which come before it
+  std::vector<size_t> dependencies;
+  // command line options with this target's flags, workdir and target applied
+  std::map<std::string, std::string> args;
+  std::string output;
+};
+
+struct Project {
+  bool ok = true;
+  std::string error;
+  // ordered so that dependencies come first
+  std::vector<ProjectTarget> targets;
+};
+
+// The plain command line: one executable from `sources` named by `target`.
+auto MakeSingleProject(const std::map<std::string, std::string>& args, std::vector<std::string> sources) -> Project;
+
+// Reads a manifest such as
+//
+//   {"targets": [
+//     {"name": "core", "type": "static", "sources": ["src/core"], "cxxflags": "-Isrc"},
+//     {"name": "app", "sources": ["src/app"], "deps": ["core"], "ldflags": "-lm"}]}
+//
+// Types are "executable" (default), "static" and "shared"; flags add to the
+// command line ones. Each target builds in <workdir>/<name>, and sources are
+// relative to the manifest.
+auto LoadProject(const std::string& path, const std::map<std::string, std::string>& args) -> Project;
+
+// Outputs of every target `index` depends on, directly or not, in link order.
+auto LinkInputs(const Project& project, size_t index) -> std::vector<std::string>;
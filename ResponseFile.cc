@@ -0,0 +1,61 @@
+#include "ResponseFile.h"
+#include "Utils.h"
+
+#include <fstream>
+
+static auto QuoteArgument(const std::string& arg) -> std::string {
+  if (arg.find_first_of(" \t\n\"'\\") == std::string::npos) {
+    return arg;
+  }
+  std::string quoted = "\"";
+  for (const auto c : arg) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  quoted += '"';
+  return quoted;
+}
+
+auto ResponseArguments(
+  const std::vector<std::string>& args,
+  const std::string& path,
+  size_t threshold) -> std::string {
+  size_t size = 0;
+  for (const auto& arg : args) {
+    size += arg.size() + 1;
+  }
+  if (size <= threshold) {
+    return JoinStrings(args);
+  }
+  // streamed into a side file, which only replaces `path` if it differs
+  const auto& temp = path + ".tmp";
+  {
+    std::ofstream stream(temp, std::ios::trunc);
+    for (const auto& arg : args) {
+      stream << QuoteArgument(arg) << '\n';
+    }
+    if (!stream.flush()) {
+      return JoinStrings(args);
+    }
+  }
+  if (!ReplaceIfChanged(temp, path)) {
+    return JoinStrings(args);
+  }
+  return '@' + path;
+}
+
+auto ResponseFlags(
+  const std::string& flags,
+  const std::string& path,
+  size_t threshold) -> std::string {
+  // the compiler reads the file without a shell to expand $VAR or `cmd`
+  if (flags.size() <= threshold || flags.find_first_of("$`") != std::string::npos) {
+    return flags;
+  }
+  if (!WriteFileIfChanged(path, flags + '\n')) {
+    return flags;
+  }
+  return '@' + path;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Argument lists longer than `threshold` bytes are written to `path` and
+// replaced by "@path", which gcc, clang and binutils all understand. The
+// joined string is returned otherwise, or if the file cannot be written.
+// An unchanged file is not rewritten.
+auto ResponseArguments(
+  const std::vector<std::string>& args,
+  const std::string& path,
+  size_t threshold) -> std::string;
+
+// Same as above for an already shell-quoted flag string. Flags relying on
+// shell expansion ($VAR, `cmd`) always stay on the command line.
+auto ResponseFlags(
+  const std::string& flags,
+  const std::string& path,
+  size_t threshold) -> std::string;
@@ -1,8 +1,11 @@
 #include "SourceAnalyzer.h"
+#include "Modules.h"
+#include "ResponseFile.h"
 #include "Utils.h"
 
 #include <algorithm>
 #include <filesystem>
+#include <sstream>
 #include <vector>
 
 static auto ShouldCompile(
@@ -20,8 +23,9 @@ static auto ShouldCompile(
 static auto GetDepfiles(
   const std::string& compiler,
   const std::string& flags,
-  const std::string& source) -> std::vector<std::string> {
-  const auto& command = JoinStrings({compiler, "-MM", source, flags});
+  const std::string& source,
+  const std::string& language = "") -> std::vector<std::string> {
+  const auto& command = JoinStrings({compiler, "-MM", flags, language, source});
   const auto& output = RunCommand(command);
   auto dependencies = RegexSplit(output, R"((\s)+(\\)*(\s)*)");
   if (dependencies.size() <= 1) {
@@ -31,11 +35,54 @@ static auto GetDepfiles(
   return dependencies;
 }
 
+// Splits -MM output for many sources into one list per source, keyed by the
+// source, which compilers name first.
+static auto SplitDepfiles(std::string output) -> std::map<std::string, std::vector<std::string>> {
+  for (auto pos = output.find("\\\n"); pos != std::string::npos; pos = output.find("\\\n", pos)) {
+    output.replace(pos, 2, " ");
+  }
+  std::map<std::string, std::vector<std::string>> rules;
+  std::istringstream stream(output);
+  for (std::string line; std::getline(stream, line);) {
+    auto dependencies = RegexSplit(line, R"((\s)+(\\)*(\s)*)");
+    dependencies.erase(
+      std::remove(dependencies.begin(), dependencies.end(), ""),
+      dependencies.end());
+    if (dependencies.size() <= 1) {
+      continue;
+    }
+    dependencies.erase(dependencies.begin());
+    const auto& source = std::filesystem::path(dependencies.front()).lexically_normal().string();
+    rules.emplace(source, std::move(dependencies));
+  }
+  return rules;
+}
+
+static auto HasDebugFlag(const std::string& flags) -> bool {
+  std::istringstream stream(flags);
+  for (std::string flag; stream >> flag;) {
+    if (flag.compare(0, 2, "-g") == 0 && flag != "-g0") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// "dir/x.cc.o" => "dir/x.cc" + extension, matching how compilers name .dwo and time trace files
+static auto ReplaceExtension(const std::string& output, const std::string& extension) -> std::string {
+  return std::filesystem::path(output).replace_extension(extension).string();
+}
+
 static auto BuildOutputPath(const std::string& workdir, const std::string& source) -> std::string {
   auto filename = std::filesystem::path(source).filename();
   return (std::filesystem::path(workdir) / filename).string() + ".o";
 }
 
+auto SourceAnalyzer::Accepts(const std::string& source) const -> bool {
+  const auto& path = std::filesystem::path(source);
+  return path.has_extension() && handlers_.count(ToLower(path.extension().string())) > 0;
+}
+
 auto SourceAnalyzer::Process(const std::string& source) const -> SourceFile {
   const auto& path = std::filesystem::path(source);
   if (!path.has_extension()) {
@@ -49,37 +96,179 @@ auto SourceAnalyzer::Process(const std::string& source) const -> SourceFile {
   return (this->*(iter->second))(source);
 }
 
+auto SourceAnalyzer::Artifacts(const std::string& source) const -> std::vector<std::string> {
+  const auto& output = BuildOutputPath(args_.at("workdir"), source);
+  return {output, output + ".rsp", output + ".d", ReplaceExtension(output, ".dwo"), ReplaceExtension(output, ".json")};
+}
+
+auto SourceAnalyzer::Outputs(const std::string& source) const -> std::vector<std::string> {
+  const auto& output = BuildOutputPath(args_.at("workdir"), source);
+  std::vector<std::string> outputs{output};
+  if (args_.at("fission") == "1") {
+    outputs.push_back(ReplaceExtension(output, ".dwo"));
+  }
+  if (args_.at("profile-headers") == "1") {
+    outputs.push_back(ReplaceExtension(output, ".json"));
+  }
+  return outputs;
+}
+
+auto SourceAnalyzer::ScanGroup(const std::string& source) const -> std::string {
+  const auto& extension = ToLower(std::filesystem::path(source).extension().string());
+  const auto& iter = handlers_.find(extension);
+  if (iter == handlers_.end() || iter->second == &SourceAnalyzer::ProcessAsm) {
+    return "";
+  }
+  // module units need scanning one at a time, and imports may hide anywhere
+  const auto c = iter->second == &SourceAnalyzer::ProcessC;
+  if (!c && args_.at("modules") == "1") {
+    return "";
+  }
+  const auto& flags = args_.at(c ? "cflags" : "cxxflags");
+  if (flags.size() >= std::stoul(args_.at("rsp"))) {
+    return "";
+  }
+  return JoinStrings({args_.at(c ? "cc" : "cxx"), "-MM", flags});
+}
+
+void SourceAnalyzer::Prescan(const std::vector<std::string>& sources) {
+  if (sources.size() < 2) {
+    return;
+  }
+  // failed sources get no rule and are scanned again alone, errors and all
+  const auto& command = JoinStrings({ScanGroup(sources.front()), JoinStrings(sources), "2>/dev/null"});
+  auto rules = SplitDepfiles(RunCommand(command));
+  std::lock_guard<std::mutex> locker(mutex_);
+  for (const auto& source : sources) {
+    const auto& iter = rules.find(std::filesystem::path(source).lexically_normal().string());
+    if (iter != rules.end()) {
+      prescanned_[source] = std::move(iter->second);
+    }
+  }
+}
+
+auto SourceAnalyzer::TakePrescanned(const std::string& source) const -> std::optional<std::vector<std::string>> {
+  std::lock_guard<std::mutex> locker(mutex_);
+  const auto& iter = prescanned_.find(source);
+  if (iter == prescanned_.end()) {
+    return std::nullopt;
+  }
+  auto dependencies = std::move(iter->second);
+  prescanned_.erase(iter);
+  return dependencies;
+}
+
 auto SourceAnalyzer::ProcessC(const std::string& source) const -> SourceFile {
   const auto& compiler = args_.at("cc");
-  const auto& flags = args_.at("cflags");
-  const auto& depfiles = GetDepfiles(compiler, flags, source);
-  auto output = BuildOutputPath(args_.at("workdir"), source);
-  std::string command;
-  if (ShouldCompile(output, depfiles)) {
-    command = JoinStrings({compiler, flags, "-o", output, "-c", source});
-  }
-  return {source, std::move(output), depfiles, std::move(command), Linker::ForC(compiler)};
+  return ProcessCompilable(source, compiler, args_.at("cflags"), Linker::ForC(compiler));
 }
 
 auto SourceAnalyzer::ProcessCpp(const std::string& source) const -> SourceFile {
   const auto& compiler = args_.at("cxx");
-  const auto& flags = args_.at("cxxflags");
-  const auto& depfiles = GetDepfiles(compiler, flags, source);
-  auto output = BuildOutputPath(args_.at("workdir"), source);
-  std::string command;
-  if (ShouldCompile(output, depfiles)) {
-    command = JoinStrings({compiler, flags, "-o", output, "-c", source});
-  }
-  return {source, std::move(output), depfiles, std::move(command), Linker::ForCpp(compiler)};
+  return ProcessCompilable(source, compiler, args_.at("cxxflags"), Linker::ForCpp(compiler), args_.at("modules") == "1");
 }
 
 auto SourceAnalyzer::ProcessAsm(const std::string& source) const -> SourceFile {
   const auto& compiler = args_.at("as");
-  const auto& flags = args_.at("asflags");
   auto output = BuildOutputPath(args_.at("workdir"), source);
+  const auto& response = output + ".rsp";
+  const auto& flags = ResponseFlags(args_.at("asflags"), response, std::stoul(args_.at("rsp")));
+  std::vector<std::string> byproducts;
+  if (!flags.empty() && flags[0] == '@') {
+    byproducts.push_back(response);
+  }
+  auto rebuild = JoinStrings({compiler, flags, "-o", output, source});
   std::string command;
   if (ShouldCompile(output, {source})) {
-    command = JoinStrings({compiler, flags, "-o", output, source});
+    command = rebuild;
   }
-  return {source, std::move(output), {source}, std::move(command), Linker::ForAsm(compiler)};
-}
\ No newline at end of file
+  return {source, std::move(output), {source}, std::move(byproducts), std::move(command), Linker::ForAsm(compiler), {}, 0, {}, {}, std::move(rebuild)};
+}
+
+auto SourceAnalyzer::ProcessCompilable(
+  const std::string& source,
+  const std::string& compiler,
+  const std::string& flags,
+  Linker linker,
+  bool modular) const -> SourceFile {
+  const auto& workdir = args_.at("workdir");
+  auto output = BuildOutputPath(workdir, source);
+  const auto& response = output + ".rsp";
+  const auto& compile_flags = ResponseFlags(flags, response, std::stoul(args_.at("rsp")));
+  // module interface extensions are unknown to the compiler driver
+  auto prescanned = TakePrescanned(source);
+  auto depfiles = prescanned ? std::move(*prescanned) : GetDepfiles(compiler, compile_flags, source, modular ? "-x c++" : "");
+  std::vector<std::string> byproducts;
+  if (args_.at("fission") == "1") {
+    byproducts.push_back(ReplaceExtension(output, ".dwo"));
+  }
+  if (args_.at("profile-headers") == "1") {
+    byproducts.push_back(ReplaceExtension(output, ".json"));
+  }
+  ModuleScan scan;
+  std::string module_flags;
+  std::string language;
+  if (modular) {
+    scan = ScanModules(cxx_kind_, compiler, compile_flags, source, output);
+    modular = !scan.provides.empty() || !scan.imports.empty();
+  }
+  if (modular) {
+    module_flags = ModuleFlags(cxx_kind_, workdir);
+    language = "-x c++";
+    if (!scan.provides.empty()) {
+      const auto& interface = ModuleInterfacePath(cxx_kind_, workdir, scan.provides);
+      byproducts.push_back(interface);
+      if (cxx_kind_ == CompilerKind::Clang) {
+        module_flags = JoinStrings({module_flags, "-fmodule-output=" + interface});
+        language = "-x c++-module";
+      }
+    }
+    // -MM may not get past imports, and a rebuilt interface invalidates importers
+    depfiles.push_back(source);
+    for (const auto& name : scan.imports) {
+      const auto& interface = ModuleInterfacePath(cxx_kind_, workdir, name);
+      if (std::filesystem::exists(interface)) {
+        depfiles.push_back(interface);
+      }
+    }
+  }
+  const auto missing = std::any_of(byproducts.begin(), byproducts.end(), [](const auto& byproduct) {
+    return !std::filesystem::exists(byproduct);
+  });
+  if (!compile_flags.empty() && compile_flags[0] == '@') {
+    byproducts.push_back(response);
+  }
+  auto rebuild = modular
+    ? JoinStrings({compiler, compile_flags, module_flags, "-o", output, "-c", language, source})
+    : JoinStrings({compiler, compile_flags, "-o", output, "-c", source});
+  std::string command;
+  if (missing || ShouldCompile(output, depfiles) || ShouldCompile(output, extra_dependencies_)) {
+    command = rebuild;
+  }
+  std::string preprocess;
+  uint64_t cutoff_seed = 0;
+  if (!command.empty() && !modular && args_.at("cutoff") == "1") {
+    // line markers only matter when they end up in debug info
+    const auto& markers = HasDebugFlag(flags) ? "" : "-P";
+    preprocess = JoinStrings({compiler, compile_flags, "-E", markers, source});
+    cutoff_seed = HashBytes(ToolStamp(compiler), HashBytes(command));
+    if (!compile_flags.empty() && compile_flags[0] == '@') {
+      cutoff_seed = HashFile(response, cutoff_seed).value_or(cutoff_seed);
+    }
+    for (const auto& dependency : extra_dependencies_) {
+      cutoff_seed = HashFile(dependency, HashBytes(dependency, cutoff_seed)).value_or(cutoff_seed);
+    }
+  }
+  return {
+    source,
+    std::move(output),
+    depfiles,
+    std::move(byproducts),
+    std::move(command),
+    std::move(linker),
+    std::move(preprocess),
+    cutoff_seed,
+    std::move(scan.provides),
+    std::move(scan.imports),
+    std::move(rebuild)};
+}
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "Toolchain.h"
+
 struct Linker {
   int priority = -1;
   std::string command;
@@ -43,8 +48,19 @@ struct SourceFile {
   std::string source;
   std::string output;
   std::vector<std::string> dependencies;
+  std::vector<std::string> byproducts;
   std::string command;
   Linker linker;
+  // prints the input whose hash decides early cutoff; empty if unsupported
+  std::string preprocess;
+  // hash of what else decides the object: command, compiler, flags file and
+  // extra dependencies such as the PGO profile; seeds the cutoff hash
+  uint64_t cutoff_seed = 0;
+  // C++ module provided by and imported into this unit
+  std::string module;
+  std::vector<std::string> imports;
+  // compiles the source even when up to date, e.g. for when an import changes
+  std::string rebuild;
 
   explicit operator bool() const {
     return !source.empty() || !output.empty();
@@ -65,16 +81,48 @@ class SourceAnalyzer {
     install(&SourceAnalyzer::ProcessC, std::array{".c"});
     install(&SourceAnalyzer::ProcessCpp, std::array{".cc", ".cpp", ".cxx", ".c++"});
     install(&SourceAnalyzer::ProcessAsm, std::array{".s", ".asm", ".nas"});
+    if (args_.at("modules") == "1") {
+      install(&SourceAnalyzer::ProcessCpp, std::array{".cppm", ".ixx"});
+      cxx_kind_ = ProbeCompilerKind(args_.at("cxx"));
+    }
   }
 
+  [[nodiscard]] auto Accepts(const std::string& path) const -> bool;
   [[nodiscard]] auto Process(const std::string& path) const -> SourceFile;
+  // every file a build of `path` may leave in workdir under any options,
+  // object first; computed from the name alone
+  [[nodiscard]] auto Artifacts(const std::string& path) const -> std::vector<std::string>;
+  // the subset of Artifacts the current options make
+  [[nodiscard]] auto Outputs(const std::string& path) const -> std::vector<std::string>;
+
+  // -MM command shared by sources that can be scanned in one process; empty
+  // for those scanned alone
+  [[nodiscard]] auto ScanGroup(const std::string& path) const -> std::string;
+  // Scans `paths` of one group at once for Process to pick up; sources the
+  // combined output has no rule for are left to Process.
+  void Prescan(const std::vector<std::string>& paths);
+
+  void AddDependency(std::string path) {
+    extra_dependencies_.push_back(std::move(path));
+  }
 
  private:
   [[nodiscard]] auto ProcessC(const std::string& path) const -> SourceFile;
   [[nodiscard]] auto ProcessCpp(const std::string& path) const -> SourceFile;
   [[nodiscard]] auto ProcessAsm(const std::string& path) const -> SourceFile;
+  [[nodiscard]] auto ProcessCompilable(
+    const std::string& path,
+    const std::string& compiler,
+    const std::string& flags,
+    Linker linker,
+    bool modular = false) const -> SourceFile;
+  [[nodiscard]] auto TakePrescanned(const std::string& path) const -> std::optional<std::vector<std::string>>;
 
  private:
   const std::map<std::string, std::string>& args_;
   std::map<std::string_view, Handler> handlers_;
+  std::vector<std::string> extra_dependencies_;
+  CompilerKind cxx_kind_ = CompilerKind::Unknown;
+  mutable std::mutex mutex_;
+  mutable std::map<std::string, std::vector<std::string>> prescanned_;
 };
@@ -0,0 +1,208 @@
+#include "Tests.h"
+#include "ResponseFile.h"
+#include "Utils.h"
+
+#include <fnmatch.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+auto IsTestSource(const std::string& source, const std::string& pattern) -> bool {
+  const auto& filename = std::filesystem::path(source).filename().string();
+  return ::fnmatch(pattern.c_str(), filename.c_str(), 0) == 0;
+}
+
+auto ParseTestShard(const std::string& text) -> std::optional<TestShard> {
+  if (text.empty()) {
+    return TestShard{};
+  }
+  const auto pos = text.find('/');
+  if (pos == std::string::npos) {
+    return std::nullopt;
+  }
+  try {
+    TestShard shard{std::stoul(text.substr(0, pos)), std::stoul(text.substr(pos + 1))};
+    if (shard.count == 0 || shard.index >= shard.count) {
+      return std::nullopt;
+    }
+    return shard;
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+auto TestBinaryPath(const std::string& workdir, const std::string& source) -> std::string {
+  return (std::filesystem::path(workdir) / std::filesystem::path(source).stem()).string();
+}
+
+auto TestLogPath(const std::string& binary) -> std::string {
+  return binary + ".log";
+}
+
+auto TestArchivePath(const std::string& workdir) -> std::string {
+  return (std::filesystem::path(workdir) / "libsb_test.a").string();
+}
+
+void PrintTestResult(std::ostream& stream, const TestResult& result) {
+  const auto* label = result.passed ? "PASS" : (result.timed_out ? "TIMEOUT" : "FAIL");
+  stream
+    << "[ " << std::setw(7) << std::left << label << std::right << " ] " << result.name
+    << " (" << std::fixed << std::setprecision(2) << result.wall << "s)" << std::endl;
+  if (result.passed) {
+    return;
+  }
+  // inserting an empty buffer would set failbit on `stream`
+  std::ifstream log(result.log);
+  if (log && log.peek() != std::ifstream::traits_type::eof()) {
+    stream << log.rdbuf();
+  }
+  if (!result.timed_out) {
+    stream << "(E) " << result.name << " exited with " << result.status << ", output in " << result.log << std::endl;
+  } else {
+    stream << "(E) " << result.name << " timed out, output in " << result.log << std::endl;
+  }
+}
+
+auto PrintTestSummary(std::ostream& stream, const std::vector<TestResult>& results) -> bool {
+  size_t passed = 0;
+  std::vector<std::string> broken;
+  for (const auto& result : results) {
+    if (result.passed) {
+      ++passed;
+    } else {
+      broken.push_back(result.ran ? result.name : result.name + " (not run)");
+    }
+  }
+  stream << passed << " of " << results.size() << " test(s) passed" << std::endl;
+  for (const auto& name : broken) {
+    stream << "  " << name << std::endl;
+  }
+  return broken.empty();
+}
+
+TestStage::TestStage(BuildContext& build, FastLinkers& fast_linkers)
+  : build_(build),
+    fast_linkers_(fast_linkers),
+    archive_(TestArchivePath(build.args.at("workdir"))) {
+}
+
+auto TestStage::Add(
+  const std::vector<std::string>& sources,
+  const std::vector<cab::TaskGraph::Id>& compiles,
+  const std::vector<cab::TaskGraph::Id>& analyses) -> bool {
+  const auto& pattern = build_.args.at("test");
+  std::vector<size_t> tests;
+  std::vector<cab::TaskGraph::Id> archive_predecessors;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (IsTestSource(sources[i], pattern)) {
+      tests.push_back(i);
+    } else {
+      archive_predecessors.push_back(compiles[i]);
+    }
+  }
+  if (tests.empty()) {
+    return false;
+  }
+  results_.resize(tests.size());
+  build_.total += tests.size() + (archive_predecessors.empty() ? 0 : 1);
+  auto link_predecessors = analyses;
+  if (!archive_predecessors.empty()) {
+    link_predecessors.push_back(build_.graph.AddAsync([this](cab::TaskGraph::Done done) {
+      Archive(std::move(done));
+    }, archive_predecessors));
+  }
+  for (size_t k = 0; k < tests.size(); ++k) {
+    const auto i = tests[k];
+    results_[k].name = TestBinaryPath(build_.args.at("workdir"), sources[i]);
+    results_[k].log = TestLogPath(results_[k].name);
+    auto predecessors = link_predecessors;
+    predecessors.push_back(compiles[i]);
+    const auto link = build_.graph.AddAsync([this, k, i](cab::TaskGraph::Done done) {
+      Link(k, i, std::move(done));
+    }, predecessors);
+    build_.graph.AddAsync([this, k](cab::TaskGraph::Done done) {
+      Run(k, std::move(done));
+    }, {link});
+  }
+  return true;
+}
+
+void TestStage::Archive(cab::TaskGraph::Done done) {
+  const auto& pattern = build_.args.at("test");
+  std::vector<std::string> objects;
+  bool stale = !std::filesystem::exists(archive_);
+  for (const auto& file : build_.files) {
+    if (file && !IsTestSource(file.source, pattern)) {
+      objects.push_back(file.output);
+      stale = stale || !file.command.empty();
+    }
+  }
+  if (!stale) {
+    std::lock_guard<std::mutex> locker(build_.mutex);
+    --build_.total;
+    done(true);
+    return;
+  }
+  const auto& response = archive_ + ".rsp";
+  const auto& members = ResponseArguments(objects, response, std::stoul(build_.args.at("rsp")));
+  const auto& command = JoinStrings({"rm -f", archive_, "&&", build_.args.at("ar"), "rcs", archive_, members});
+  build_.Progress(build_.verbose ? command : archive_);
+  build_.processes.Spawn(command, [this, response, members, done](const ProcessResult& process) {
+    archived_ = static_cast<bool>(process);
+    if (archived_) {
+      std::vector<std::string> byproducts;
+      if (members[0] == '@') {
+        byproducts.push_back(response);
+      }
+      build_.log.Update(archive_, {process.wall, process.user, process.system, process.max_rss, 0, 0, std::move(byproducts)});
+    } else {
+      std::cerr << "(E) failed to archive " << archive_ << std::endl;
+    }
+    done(archived_);
+  });
+}
+
+void TestStage::Link(size_t k, size_t i, cab::TaskGraph::Done done) {
+  const auto& file = build_.files[i];
+  const auto& binary = results_[k].name;
+  if (file.command.empty() && !archived_ && std::filesystem::exists(binary)) {
+    std::lock_guard<std::mutex> locker(build_.mutex);
+    --build_.total;
+    done(true);
+    return;
+  }
+  const auto& linker = build_.linkers.front();
+  const auto& objects = JoinStrings({file.output, std::filesystem::exists(archive_) ? archive_ : ""});
+  const auto& ldflags = fast_linkers_.Flags(linker, build_.args.at("ldflags")).first;
+  const auto& command = JoinStrings({linker.command, ldflags, "-o", binary, objects});
+  build_.Progress(build_.verbose ? command : binary);
+  build_.processes.Spawn(command, [this, binary, done](const ProcessResult& process) {
+    const auto ok = static_cast<bool>(process);
+    if (ok) {
+      build_.log.Update(binary, {process.wall, process.user, process.system, process.max_rss, 0, 0, {TestLogPath(binary)}});
+    } else {
+      std::lock_guard<std::mutex> locker(build_.mutex);
+      std::cerr << "(E) failed to link " << binary << std::endl;
+    }
+    done(ok);
+  });
+}
+
+void TestStage::Run(size_t k, cab::TaskGraph::Done done) {
+  const auto& command = "exec " + results_[k].name + " > " + results_[k].log + " 2>&1";
+  build_.processes.Spawn(command, [this, k, done](const ProcessResult& process) {
+    auto& result = results_[k];
+    result.ran = true;
+    result.passed = static_cast<bool>(process);
+    result.timed_out = process.timed_out;
+    result.status = process.status;
+    result.wall = process.wall;
+    {
+      std::lock_guard<std::mutex> locker(build_.mutex);
+      PrintTestResult(std::cout, result);
+    }
+    done(result.passed);
+  }, std::stod(build_.args.at("timeout")));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cab/TaskGraph.h"
+
+#include "Build.h"
+#include "Link.h"
+
+constexpr auto kDefaultTestPattern = "*_test.*";
+
+// Matches the file name of `source` against a shell pattern.
+auto IsTestSource(const std::string& source, const std::string& pattern) -> bool;
+
+// "i/n" selects every n-th test starting at the i-th, counting from zero.
+struct TestShard {
+  size_t index = 0;
+  size_t count = 1;
+
+  [[nodiscard]] auto Contains(size_t n) const -> bool {
+    return n % count == index;
+  }
+};
+
+auto ParseTestShard(const std::string& text) -> std::optional<TestShard>;
+
+// "dir/x_test.cc" => "workdir/x_test" and its captured output "workdir/x_test.log"
+auto TestBinaryPath(const std::string& workdir, const std::string& source) -> std::string;
+auto TestLogPath(const std::string& binary) -> std::string;
+// static archive holding the objects every test links against
+auto TestArchivePath(const std::string& workdir) -> std::string;
+
+struct TestResult {
+  std::string name;
+  std::string log;
+  bool ran = false;
+  bool passed = false;
+  bool timed_out = false;
+  int status = 0;
+  double wall = 0;
+};
+
+void PrintTestResult(std::ostream& stream, const TestResult& result);
+// Returns whether every test passed.
+auto PrintTestSummary(std::ostream& stream, const std::vector<TestResult>& results) -> bool;
+
+// Links every test among the sources against an archive of the other
+// objects, then runs each with timeout= once it is linked.
+class TestStage {
+ public:
+  TestStage(BuildContext& build, FastLinkers& fast_linkers);
+
+  // Adds the tasks for `sources`, each compiled by `compiles[i]` after
+  // `analyses` tell what changed; false if none of them is a test.
+  auto Add(
+    const std::vector<std::string>& sources,
+    const std::vector<cab::TaskGraph::Id>& compiles,
+    const std::vector<cab::TaskGraph::Id>& analyses) -> bool;
+
+  [[nodiscard]] auto Results() const -> const std::vector<TestResult>& {
+    return results_;
+  }
+
+ private:
+  void Archive(cab::TaskGraph::Done done);
+  void Link(size_t k, size_t i, cab::TaskGraph::Done done);
+  void Run(size_t k, cab::TaskGraph::Done done);
+
+ private:
+  BuildContext& build_;
+  FastLinkers& fast_linkers_;
+  std::string archive_;
+  std::vector<TestResult> results_;
+  std::atomic_bool archived_ = false;
+};
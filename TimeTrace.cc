@@ -0,0 +1,118 @@
+#include "TimeTrace.h"
+#include "Json.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+static void Accumulate(std::map<std::string, TimeTraceItem>& items, const std::string& name, double seconds) {
+  auto& item = items[name];
+  item.name = name;
+  item.seconds += seconds;
+  ++item.count;
+}
+
+static auto TopItems(std::vector<TimeTraceItem> items, size_t n) -> std::vector<TimeTraceItem> {
+  std::sort(items.begin(), items.end(), [](const auto& a, const auto& b) {
+    return a.seconds > b.seconds;
+  });
+  if (items.size() > n) {
+    items.resize(n);
+  }
+  return items;
+}
+
+static auto TopItems(const std::map<std::string, TimeTraceItem>& items, size_t n) -> std::vector<TimeTraceItem> {
+  std::vector<TimeTraceItem> values;
+  values.reserve(items.size());
+  for (const auto& [name, item] : items) {
+    values.push_back(item);
+  }
+  return TopItems(std::move(values), n);
+}
+
+auto TimeTraceProfile::Add(const std::string& unit, const std::string& trace) -> bool {
+  const auto& document = JsonValue::ParseFile(trace);
+  if (!document) {
+    return false;
+  }
+  const auto* events = document->Find("traceEvents");
+  if (events == nullptr) {
+    return false;
+  }
+  TimeTraceItem codegen{unit, 0, 1};
+  for (const auto& event : events->AsArray()) {
+    const auto* phase = event.Find("ph");
+    const auto* name = event.Find("name");
+    const auto* duration = event.Find("dur");
+    if (phase == nullptr || phase->AsString() != "X" || name == nullptr || duration == nullptr) {
+      continue;
+    }
+    const auto seconds = duration->AsNumber() / 1e6;
+    const auto& kind = name->AsString();
+    if (kind == "Backend") {
+      codegen.seconds += seconds;
+      continue;
+    }
+    const auto* args = event.Find("args");
+    const auto* detail = args != nullptr ? args->Find("detail") : nullptr;
+    if (detail == nullptr) {
+      continue;
+    }
+    if (kind == "Source") {
+      Accumulate(headers_, detail->AsString(), seconds);
+    } else if (kind == "InstantiateClass" || kind == "InstantiateFunction") {
+      Accumulate(templates_, detail->AsString(), seconds);
+    }
+  }
+  units_.push_back(std::move(codegen));
+  return true;
+}
+
+auto TimeTraceProfile::Headers(size_t n) const -> std::vector<TimeTraceItem> {
+  return TopItems(headers_, n);
+}
+
+auto TimeTraceProfile::Templates(size_t n) const -> std::vector<TimeTraceItem> {
+  return TopItems(templates_, n);
+}
+
+auto TimeTraceProfile::Units(size_t n) const -> std::vector<TimeTraceItem> {
+  return TopItems(units_, n);
+}
+
+void TimeTraceProfile::Print(std::ostream& stream, size_t n) const {
+  const auto print = [&](const char* title, const std::vector<TimeTraceItem>& items) {
+    stream << title << ":" << std::endl;
+    for (const auto& item : items) {
+      stream
+        << "  " << std::fixed << std::setprecision(3) << std::setw(9) << item.seconds << "s"
+        << std::setw(7) << item.count << "x  " << item.name << std::endl;
+    }
+  };
+  stream << "Time trace of " << units_.size() << " unit(s)" << std::endl;
+  print("Headers by total parse time", Headers(n));
+  print("Templates by total instantiation time", Templates(n));
+  print("Units by codegen time", Units(n));
+}
+
+auto TimeTraceProfile::WriteJson(const std::string& path, size_t n) const -> bool {
+  std::ofstream stream(path, std::ios::trunc);
+  const auto write = [&](const char* key, const std::vector<TimeTraceItem>& items, bool last) {
+    stream << "  " << JsonQuote(key) << ": [";
+    for (size_t i = 0; i < items.size(); ++i) {
+      stream
+        << (i == 0 ? "\n" : ",\n")
+        << "    {\"name\": " << JsonQuote(items[i].name)
+        << ", \"seconds\": " << items[i].seconds
+        << ", \"count\": " << items[i].count << "}";
+    }
+    stream << (items.empty() ? "]" : "\n  ]") << (last ? "\n" : ",\n");
+  };
+  stream << "{\n  \"units\": " << units_.size() << ",\n";
+  write("headers", Headers(n), false);
+  write("templates", Templates(n), false);
+  write("codegen", Units(n), true);
+  stream << "}\n";
+  return static_cast<bool>(stream.flush());
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct TimeTraceItem {
+  std::string name;
+  double seconds = 0;
+  size_t count = 0;
+};
+
+// Aggregates clang -ftime-trace files across translation units.
+class TimeTraceProfile {
+ public:
+  auto Add(const std::string& unit, const std::string& trace) -> bool;
+
+  [[nodiscard]] auto Headers(size_t n) const -> std::vector<TimeTraceItem>;
+  [[nodiscard]] auto Templates(size_t n) const -> std::vector<TimeTraceItem>;
+  [[nodiscard]] auto Units(size_t n) const -> std::vector<TimeTraceItem>;
+
+  void Print(std::ostream& stream, size_t n) const;
+  [[nodiscard]] auto WriteJson(const std::string& path, size_t n) const -> bool;
+
+ private:
+  std::map<std::string, TimeTraceItem> headers_;
+  std::map<std::string, TimeTraceItem> templates_;
+  std::vector<TimeTraceItem> units_;
+};
@@ -0,0 +1,136 @@
+#include "Toolchain.h"
+#include "Utils.h"
+
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+auto ProbeCompilerKind(const std::string& compiler) -> CompilerKind {
+  const auto& output = RunCommand(compiler + " --version 2>/dev/null");
+  if (output.find("clang") != std::string::npos) {
+    return CompilerKind::Clang;
+  }
+  if (output.find("Free Software Foundation") != std::string::npos) {
+    return CompilerKind::Gcc;
+  }
+  return CompilerKind::Unknown;
+}
+
+static auto ResolveProgram(const std::string& name) -> std::filesystem::path {
+  std::error_code err;
+  if (name.find('/') != std::string::npos) {
+    return std::filesystem::canonical(name, err);
+  }
+  const auto* path = std::getenv("PATH");
+  for (const auto& dir : RegexSplit(path ? path : "", ":")) {
+    const auto& candidate = std::filesystem::path(dir.empty() ? "." : dir) / name;
+    if (::access(candidate.c_str(), X_OK) == 0) {
+      return std::filesystem::canonical(candidate, err);
+    }
+  }
+  return {};
+}
+
+auto ToolStamp(const std::string& command) -> std::string {
+  std::string stamp;
+  for (const auto& word : RegexSplit(command, "\\s+")) {
+    if (word.empty()) {
+      continue;
+    }
+    if (word[0] == '-') {
+      break;
+    }
+    const auto& path = ResolveProgram(word);
+    std::error_code err;
+    const auto mtime = std::filesystem::last_write_time(path, err);
+    stamp = JoinStrings({stamp, path.string() + '@' + std::to_string(err ? 0 : mtime.time_since_epoch().count())});
+  }
+  return stamp;
+}
+
+auto ProbeLinkerFlag(const std::string& linker, const std::string& flag) -> bool {
+  static std::mutex mutex;
+  static std::map<std::pair<std::string, std::string>, bool> probed;
+  static std::atomic_size_t sequence = 0;
+  {
+    std::lock_guard<std::mutex> locker(mutex);
+    const auto& iter = probed.find({linker, flag});
+    if (iter != probed.end()) {
+      return iter->second;
+    }
+  }
+  // concurrent links probe at the same time, each into its own file
+  const auto& name = "sb-probe-" + std::to_string(::getpid()) + "-" + std::to_string(sequence++);
+  const auto& output = std::filesystem::temp_directory_path() / name;
+  const auto& command = JoinStrings({
+    "printf 'int main(void){return 0;}\\n' |",
+    linker, "-x c - -o", output.string(), flag, ">/dev/null 2>&1"});
+  const auto ok = std::system(command.c_str()) == 0;
+  std::error_code err;
+  std::filesystem::remove(output, err);
+  std::lock_guard<std::mutex> locker(mutex);
+  probed[{linker, flag}] = ok;
+  return ok;
+}
+
+static auto FastLinkerFlags(const std::string& name, size_t threads) -> std::string {
+  const auto& count = std::to_string(threads);
+  if (name == "mold") {
+    return "-fuse-ld=mold -Wl,--thread-count=" + count;
+  }
+  if (name == "lld") {
+    return "-fuse-ld=lld -Wl,--threads=" + count;
+  }
+  if (name == "gold") {
+    return "-fuse-ld=gold -Wl,--threads,--thread-count," + count;
+  }
+  return "";
+}
+
+static auto FastLinkerKey(const std::string& driver) -> std::string {
+  return JoinStrings({driver, ToolStamp(driver), ToolStamp("ld.mold ld.lld ld.gold")});
+}
+
+auto ProbeFastLinker(const std::string& driver, size_t threads, const std::string& cache) -> FastLinker {
+  // lines of "key\tname", with an empty name when nothing worked; the key
+  // changes when the driver is replaced or one of the linkers is installed
+  const auto& key = FastLinkerKey(driver);
+  {
+    // the last answer wins, see DropFastLinker
+    std::optional<std::string> found;
+    std::ifstream stream(cache);
+    for (std::string line; std::getline(stream, line);) {
+      const auto pos = line.find('\t');
+      if (pos != std::string::npos && line.compare(0, pos, key) == 0 && pos == key.size()) {
+        found = line.substr(pos + 1);
+      }
+    }
+    if (found) {
+      return {*found, FastLinkerFlags(*found, threads)};
+    }
+  }
+  FastLinker linker;
+  for (const auto& name : std::array{"mold", "lld", "gold"}) {
+    // a thread flag the linker rejects fails the probe as well
+    if (ProbeLinkerFlag(driver, FastLinkerFlags(name, threads))) {
+      linker = {name, FastLinkerFlags(name, threads)};
+      break;
+    }
+  }
+  std::ofstream stream(cache, std::ios::app);
+  stream << key << '\t' << linker.name << '\n';
+  return linker;
+}
+
+void DropFastLinker(const std::string& driver, const std::string& cache) {
+  std::ofstream stream(cache, std::ios::app);
+  stream << FastLinkerKey(driver) << "\t\n";
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+enum class CompilerKind {
+  Unknown,
+  Gcc,
+  Clang,
+};
+
+auto ProbeCompilerKind(const std::string& compiler) -> CompilerKind;
+
+// Resolved path and mtime of the programs leading `command` (e.g. "ccache
+// g++"), which change when the toolchain is replaced or upgraded.
+auto ToolStamp(const std::string& command) -> std::string;
+
+// Checks whether linking a trivial C program with `flag` succeeds, once per
+// linker and flag.
+auto ProbeLinkerFlag(const std::string& linker, const std::string& flag) -> bool;
+
+struct FastLinker {
+  // "mold", "lld" or "gold"; empty when none of them links
+  std::string name;
+  std::string flags;
+
+  explicit operator bool() const {
+    return !name.empty();
+  }
+};
+
+// Picks the first of mold, lld and gold that `driver` can link with, with
+// flags to run it on `threads` threads. Answers are kept in the file `cache`
+// per driver and the installed linkers, so a toolchain is probed only once.
+auto ProbeFastLinker(const std::string& driver, size_t threads, const std::string& cache) -> FastLinker;
+
+// Records in `cache` that the fast linker of `driver` failed a real link, so
+// that later builds keep the driver's default linker.
+void DropFastLinker(const std::string& driver, const std::string& cache);
@@ -1,6 +1,14 @@
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
 #include <array>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <memory>
 #include <regex>
 #include <string>
@@ -28,3 +36,106 @@ auto RunCommand(const std::string& cmd) -> std::string {
   }
   return result;
 }
+
+extern char** environ;
+
+auto SpawnProcess(const std::string& cmd) -> int {
+  const char* argv[] = {"sh", "-c", cmd.c_str(), nullptr};
+  pid_t pid = 0;
+  const auto err = ::posix_spawn(&pid, "/bin/sh", nullptr, nullptr, const_cast<char**>(argv), environ);
+  if (err != 0) {
+    std::cerr << "(E) failed to spawn " << cmd << ": " << std::strerror(err) << std::endl;
+    return -1;
+  }
+  return pid;
+}
+
+auto ReapProcess(int pid, bool block) -> std::optional<ProcessResult> {
+  ProcessResult result;
+  int status = 0;
+  struct rusage usage {};
+  while (true) {
+    const auto reaped = ::wait4(pid, &status, block ? 0 : WNOHANG, &usage);
+    if (reaped == pid) {
+      break;
+    }
+    if (reaped == 0) {
+      return std::nullopt;
+    }
+    if (errno != EINTR) {
+      return result;
+    }
+  }
+  result.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  result.user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  result.system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+  result.max_rss = usage.ru_maxrss / 1024;
+#else
+  result.max_rss = usage.ru_maxrss;
+#endif
+  return result;
+}
+
+auto RunProcess(const std::string& cmd) -> ProcessResult {
+  Stopwatch watch;
+  const auto pid = SpawnProcess(cmd);
+  if (pid < 0) {
+    return {};
+  }
+  auto result = *ReapProcess(pid, true);
+  result.wall = watch.Elapsed();
+  return result;
+}
+
+auto HashFile(const std::string& path, uint64_t hash) -> std::optional<uint64_t> {
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    return std::nullopt;
+  }
+  std::array<char, 65536> buffer{};
+  while (stream.read(buffer.data(), buffer.size()) || stream.gcount() > 0) {
+    hash = HashBytes({buffer.data(), static_cast<size_t>(stream.gcount())}, hash);
+  }
+  return hash;
+}
+
+static auto SameContent(const std::string& p1, const std::string& p2) -> bool {
+  std::error_code err;
+  const auto size = std::filesystem::file_size(p1, err);
+  if (err || size != std::filesystem::file_size(p2, err) || err) {
+    return false;
+  }
+  std::ifstream s1(p1, std::ios::binary);
+  std::ifstream s2(p2, std::ios::binary);
+  std::array<char, 65536> b1{};
+  std::array<char, 65536> b2{};
+  while (s1.read(b1.data(), b1.size()) || s1.gcount() > 0) {
+    const auto n = s1.gcount();
+    if (!s2.read(b2.data(), n) || std::memcmp(b1.data(), b2.data(), n) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto ReplaceIfChanged(const std::string& temp, const std::string& path) -> bool {
+  std::error_code err;
+  if (SameContent(temp, path)) {
+    std::filesystem::remove(temp, err);
+    return true;
+  }
+  std::filesystem::rename(temp, path, err);
+  return !err;
+}
+
+auto WriteFileIfChanged(const std::string& path, const std::string& content) -> bool {
+  const auto& temp = path + ".tmp";
+  {
+    std::ofstream stream(temp, std::ios::binary | std::ios::trunc);
+    if (!(stream << content).flush()) {
+      return false;
+    }
+  }
+  return ReplaceIfChanged(temp, path);
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <initializer_list>
 #include <cstring>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -51,10 +55,71 @@ auto RegexSplit(const std::string& str, const std::string& pattern) -> std::vect
 
 auto RunCommand(const std::string& cmd) -> std::string;
 
+struct ProcessResult {
+  int status = -1;
+  double wall = 0;
+  double user = 0;
+  double system = 0;
+  long max_rss = 0;  // KiB, of the largest single process in the tree
+  bool timed_out = false;
+
+  explicit operator bool() const {
+    return status == 0;
+  }
+};
+
+// Starts `cmd` through /bin/sh, returns its pid or -1 after reporting why.
+auto SpawnProcess(const std::string& cmd) -> int;
+// Collects the exit status and usage of `pid` with wait4(), leaving `wall`
+// to the caller; nullopt if not blocking and the child is still running.
+// Times add up all reaped descendants, but ru_maxrss is only the peak of
+// the largest one (e.g. cc1plus under the driver), not their sum.
+auto ReapProcess(int pid, bool block) -> std::optional<ProcessResult>;
+// Runs `cmd` through /bin/sh and reaps it with wait4() to collect its usage.
+auto RunProcess(const std::string& cmd) -> ProcessResult;
+
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+inline auto HashBytes(std::string_view bytes, uint64_t hash = kHashSeed) -> uint64_t {
+  for (const auto c : bytes) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+auto HashFile(const std::string& path, uint64_t hash = kHashSeed) -> std::optional<uint64_t>;
+
+// Moves `temp` over `path`, or drops it when `path` already has the same
+// content, so that the mtime of `path` only changes with its content.
+auto ReplaceIfChanged(const std::string& temp, const std::string& path) -> bool;
+// Leaves `path` and its mtime alone when it already holds `content`.
+auto WriteFileIfChanged(const std::string& path, const std::string& content) -> bool;
+
+inline void Touch(const std::string& path) {
+  std::error_code err;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), err);
+}
+
 inline auto IsNewer(const std::string& p1, const std::string& p2) -> bool {
   return std::filesystem::last_write_time(p1) > std::filesystem::last_write_time(p2);
 }
 
+class Stopwatch {
+ public:
+  Stopwatch()
+    : start_(std::chrono::steady_clock::now()) {
+  }
+
+  [[nodiscard]] auto Elapsed() const -> double {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+    return elapsed.count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
 template <class Filter, class Collector>
 void WalkDirectory(const std::string& path, Filter filter, Collector collector) {
   for (std::vector<std::string> stack{path}; !stack.empty();) {
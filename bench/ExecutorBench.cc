@@ -0,0 +1,54 @@
+// Measures executor queue contention: 200k trivial jobs pushed one at a time
+// or in one batch, taken by 1, 8 and 64 workers, with BlockingQueue and the
+// lock-free BoundedQueue behind the executor.
+//
+//   c++ -std=c++17 -O2 -pthread -o work/executor_bench bench/ExecutorBench.cc
+//   ./work/executor_bench [jobs]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../cab/BlockingQueue.h"
+#include "../cab/BoundedQueue.h"
+#include "../cab/Executor.h"
+
+template <template <typename> class Queue>
+static auto Run(unsigned int workers, size_t jobs, bool batched) -> double {
+  cab::BasicExecutor<Queue> executor;
+  executor.Start(workers);
+  std::atomic_size_t done = 0;
+  const auto start = std::chrono::steady_clock::now();
+  if (batched) {
+    std::vector<std::function<void(void)>> batch(jobs, [&done]() { ++done; });
+    executor.PushBatch(batch);
+  } else {
+    for (size_t i = 0; i < jobs; ++i) {
+      executor.Push([&done]() { ++done; });
+    }
+  }
+  executor.Stop();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (done != jobs) {
+    std::fprintf(stderr, "lost %zu job(s)\n", jobs - done);
+    std::exit(EXIT_FAILURE);
+  }
+  return elapsed.count();
+}
+
+auto main(int argc, char* argv[]) -> int {
+  const size_t jobs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+  std::printf("%zu job(s)\n%8s %12s %12s %12s %12s\n", jobs, "workers", "blocking", "batched", "lock-free", "lf-batched");
+  for (const auto workers : {1u, 8u, 64u}) {
+    std::printf(
+      "%8u %11.3fs %11.3fs %11.3fs %11.3fs\n",
+      workers,
+      Run<cab::BlockingQueue>(workers, jobs, false),
+      Run<cab::BlockingQueue>(workers, jobs, true),
+      Run<cab::BoundedQueue>(workers, jobs, false),
+      Run<cab::BoundedQueue>(workers, jobs, true));
+  }
+  return EXIT_SUCCESS;
+}
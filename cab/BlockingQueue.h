@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <condition_variable>
 #include <deque>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 namespace cab {
 
@@ -23,38 +26,62 @@ class BlockingQueue {
   void PushBack(Arg&& data) {
     std::lock_guard<std::mutex> locker(mutex_);
     queue_.push_back(std::forward<Arg>(data));
-    condition_.notify_all();
+    Notify(1);
   }
 
   template <typename... Args>
   void EmplaceBack(Args&&... args) {
     std::lock_guard<std::mutex> locker(mutex_);
     queue_.emplace_back(std::forward<Args>(args)...);
-    condition_.notify_all();
+    Notify(1);
   }
 
   template <typename Arg>
   void PushFront(Arg&& data) {
     std::lock_guard<std::mutex> locker(mutex_);
     queue_.push_front(std::forward<Arg>(data));
-    condition_.notify_all();
+    Notify(1);
   }
 
   template <typename... Args>
   void EmplaceFront(Args&&... args) {
     std::lock_guard<std::mutex> locker(mutex_);
     queue_.emplace_front(std::forward<Args>(args)...);
-    condition_.notify_all();
+    Notify(1);
+  }
+
+  // Moves [first, last) in under one lock and wakes at most one taker per item.
+  template <typename Iter>
+  void PushBackRange(Iter first, Iter last) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    const auto n = queue_.size();
+    queue_.insert(queue_.end(), std::make_move_iterator(first), std::make_move_iterator(last));
+    Notify(queue_.size() - n);
   }
 
   auto Take() {
     std::unique_lock<std::mutex> locker(mutex_);
-    condition_.wait(locker, [this] { return not queue_.empty(); });
+    WaitNotEmpty(locker);
     auto data = std::move(queue_.front());
     queue_.pop_front();
     return data;
   }
 
+  // Blocks until at least one item is available, then takes up to n items.
+  auto TakeBatch(size_t n) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    WaitNotEmpty(locker);
+    const auto count = std::min(n, queue_.size());
+    std::vector<T> items(
+      std::make_move_iterator(queue_.begin()),
+      std::make_move_iterator(queue_.begin() + count));
+    queue_.erase(queue_.begin(), queue_.begin() + count);
+    if (!queue_.empty() && takers_ > 0) {
+      not_empty_.notify_one();
+    }
+    return items;
+  }
+
   auto TryTake() {
     std::unique_lock<std::mutex> locker(mutex_);
     if (queue_.empty()) {
@@ -67,7 +94,9 @@ class BlockingQueue {
 
   void Wait(size_t n) {
     std::unique_lock<std::mutex> locker(mutex_);
-    condition_.wait(locker, [this, n] { return queue_.size() >= n; });
+    ++size_waiters_;
+    size_changed_.wait(locker, [this, n] { return queue_.size() >= n; });
+    --size_waiters_;
   }
 
   void Clear() {
@@ -81,16 +110,44 @@ class BlockingQueue {
   }
 
   auto Size() const {
+    std::lock_guard<std::mutex> locker(mutex_);
     return queue_.size();
   }
 
   auto Empty() const {
+    std::lock_guard<std::mutex> locker(mutex_);
     return queue_.empty();
   }
 
  private:
-  std::mutex mutex_;
-  std::condition_variable condition_;
+  void WaitNotEmpty(std::unique_lock<std::mutex>& locker) {
+    ++takers_;
+    not_empty_.wait(locker, [this] { return not queue_.empty(); });
+    --takers_;
+  }
+
+  // called with mutex_ held after n items were added
+  void Notify(size_t n) {
+    if (takers_ > 0) {
+      if (n >= takers_) {
+        not_empty_.notify_all();
+      } else {
+        for (size_t i = 0; i < n; ++i) {
+          not_empty_.notify_one();
+        }
+      }
+    }
+    if (size_waiters_ > 0) {
+      size_changed_.notify_all();
+    }
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable size_changed_;
+  size_t takers_ = 0;
+  size_t size_waiters_ = 0;
   std::deque<T> queue_;
 };
 }  // namespace cab
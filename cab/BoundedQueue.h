@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace cab {
+
+// Bounded lock-free multi-producer multi-consumer queue (Vyukov's ring of
+// sequenced cells) offering the back-insert and take subset of
+// BlockingQueue, which is all BasicExecutor needs. A ring only hands out
+// items in order, so there is no PushFront. Blocking calls spin, then
+// yield, then sleep briefly.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity = 4096) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    cells_ = std::make_unique<Cell[]>(size);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  ~BoundedQueue() = default;
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue(BoundedQueue&&) = delete;
+
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(BoundedQueue&&) = delete;
+
+  template <typename Arg>
+  auto TryPushBack(Arg&& data) -> bool {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      auto& cell = cells_[pos & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = std::forward<Arg>(data);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template <typename Arg>
+  void PushBack(Arg&& data) {
+    T item(std::forward<Arg>(data));
+    for (size_t spins = 0; !TryPushBack(std::move(item)); ++spins) {
+      Backoff(spins);
+    }
+  }
+
+  template <typename... Args>
+  void EmplaceBack(Args&&... args) {
+    PushBack(T(std::forward<Args>(args)...));
+  }
+
+  template <typename Iter>
+  void PushBackRange(Iter first, Iter last) {
+    for (; first != last; ++first) {
+      PushBack(std::move(*first));
+    }
+  }
+
+  auto TryTake(T& data) -> bool {
+    auto pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      auto& cell = cells_[pos & mask_];
+      const auto sequence = cell.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          data = std::move(cell.data);
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  auto TryTake() {
+    T data{};
+    TryTake(data);
+    return data;
+  }
+
+  auto Take() {
+    T data{};
+    for (size_t spins = 0; !TryTake(data); ++spins) {
+      Backoff(spins);
+    }
+    return data;
+  }
+
+  auto TakeBatch(size_t n) {
+    std::vector<T> items;
+    items.push_back(Take());
+    for (T data{}; items.size() < n && TryTake(data);) {
+      items.push_back(std::move(data));
+    }
+    return items;
+  }
+
+  // Blocks until at least `n` items are queued.
+  void Wait(size_t n) {
+    for (size_t spins = 0; Size() < n; ++spins) {
+      Backoff(spins);
+    }
+  }
+
+  void Clear() {
+    for (T data{}; TryTake(data);) {
+    }
+  }
+
+  // approximate while other threads are pushing or taking
+  auto Size() const -> size_t {
+    const auto tail = tail_.load(std::memory_order_acquire);
+    const auto head = head_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  auto Empty() const -> bool {
+    return Size() == 0;
+  }
+
+  auto Capacity() const -> size_t {
+    return mask_ + 1;
+  }
+
+ private:
+  static void Backoff(size_t spins) {
+    if (spins < 64) {
+      return;
+    }
+    if (spins < 128) {
+      std::this_thread::yield();
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+};
+}  // namespace cab
@@ -1,53 +1,91 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <vector>
 
 #include "BlockingQueue.h"
+#include "Histogram.h"
 
 namespace cab {
 
-class Executor {
+template <template <typename> class Queue>
+class BasicExecutor {
  public:
   using Job = std::function<void(void)>;
+  using Clock = std::chrono::steady_clock;
+
+  struct WorkerStats {
+    double busy = 0;
+    double idle = 0;
+  };
+
+  // Durations are in microseconds.
+  struct Stats {
+    Histogram::Snapshot wait;
+    Histogram::Snapshot run;
+    std::vector<WorkerStats> workers;
+  };
 
  public:
-  Executor() = default;
-  Executor(const Executor&) = delete;
-  Executor(Executor&&) = delete;
-  auto operator=(const Executor&) -> Executor& = delete;
-  auto operator=(Executor &&) -> Executor& = delete;
+  BasicExecutor() = default;
+  BasicExecutor(const BasicExecutor&) = delete;
+  BasicExecutor(BasicExecutor&&) = delete;
+  auto operator=(const BasicExecutor&) -> BasicExecutor& = delete;
+  auto operator=(BasicExecutor&&) -> BasicExecutor& = delete;
 
-  ~Executor() {
+  ~BasicExecutor() {
     Stop();
   }
 
+  // Must be called before Start().
+  void EnableStats(bool enable = true) {
+    stats_enabled_ = enable;
+  }
+
   void Start(unsigned int n = 0) {
     if (n == 0) {
       n = std::thread::hardware_concurrency();
     }
+    workers_ = std::make_unique<Worker[]>(n);
     for (auto i = 0u; i < n; ++i) {
-      threads_.emplace_back([this]() {
+      threads_.emplace_back([this, &worker = workers_[i]]() {
         while (true) {
-          auto job = queue_.Take();
-          if (!job) {
+          if (!stats_enabled_) {
+            auto task = queue_.Take();
+            if (!task.job) {
+              return;
+            }
+            task.job();
+            continue;
+          }
+          const auto idle_start = Clock::now();
+          auto task = queue_.Take();
+          const auto start = Clock::now();
+          worker.idle += Nanoseconds(start - idle_start);
+          if (!task.job) {
             return;
           }
-          job();
+          wait_.Record(Nanoseconds(start - task.enqueued) / 1000);
+          task.job();
+          const auto run = Nanoseconds(Clock::now() - start);
+          worker.busy += run;
+          run_.Record(run / 1000);
         }
       });
     }
   }
 
+  // With `now`, pending jobs are dropped instead of being drained first.
   void Stop(bool now = false) {
-    for (size_t i = 0; i < threads_.size(); ++i) {
-      if (now) {
-        queue_.EmplaceFront(nullptr);
-      } else {
-        queue_.EmplaceBack(nullptr);
-      }
+    if (now) {
+      queue_.Clear();
     }
+    std::vector<Task> sentinels(threads_.size());
+    queue_.PushBackRange(sentinels.begin(), sentinels.end());
     for (auto& thread : threads_) {
       thread.join();
     }
@@ -56,8 +94,21 @@ class Executor {
 
   void Push(Job job) {
     if (job) {
-      queue_.PushBack(std::move(job));
+      queue_.PushBack(Task{std::move(job), stats_enabled_ ? Clock::now() : Clock::time_point{}});
+    }
+  }
+
+  template <typename Jobs>
+  void PushBatch(Jobs&& jobs) {
+    std::vector<Task> tasks;
+    tasks.reserve(jobs.size());
+    const auto enqueued = stats_enabled_ ? Clock::now() : Clock::time_point{};
+    for (auto& job : jobs) {
+      if (job) {
+        tasks.push_back(Task{std::move(job), enqueued});
+      }
     }
+    queue_.PushBackRange(tasks.begin(), tasks.end());
   }
 
   void Clear() {
@@ -72,9 +123,39 @@ class Executor {
     return queue_.Empty();
   }
 
+  [[nodiscard]] auto Snapshot() const -> Stats {
+    Stats stats{wait_.Take(), run_.Take(), {}};
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      const auto& worker = workers_[i];
+      stats.workers.push_back({worker.busy.load() / 1e9, worker.idle.load() / 1e9});
+    }
+    return stats;
+  }
+
+ private:
+  struct Task {
+    Job job;
+    Clock::time_point enqueued;
+  };
+
+  struct alignas(64) Worker {
+    std::atomic<uint64_t> busy = 0;
+    std::atomic<uint64_t> idle = 0;
+  };
+
+  static auto Nanoseconds(Clock::duration duration) -> uint64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  }
+
  private:
-  BlockingQueue<Job> queue_;
+  Queue<Task> queue_;
   std::vector<std::thread> threads_;
+  std::unique_ptr<Worker[]> workers_;
+  bool stats_enabled_ = false;
+  Histogram wait_;
+  Histogram run_;
 };
 
+using Executor = BasicExecutor<BlockingQueue>;
+
 }  // namespace cab
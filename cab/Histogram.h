@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace cab {
+
+// Log2-bucketed histogram that can be recorded into from many threads.
+class Histogram {
+ public:
+  static constexpr size_t kBuckets = 40;
+
+  struct Snapshot {
+    std::array<uint64_t, kBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    [[nodiscard]] auto Mean() const -> double {
+      return count == 0 ? 0 : static_cast<double>(sum) / count;
+    }
+
+    // upper bound of the bucket containing the p-th percentile
+    [[nodiscard]] auto Percentile(double p) const -> uint64_t {
+      if (count == 0) {
+        return 0;
+      }
+      const auto rank = static_cast<uint64_t>(p * (count - 1));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+          return std::min<uint64_t>(max, (uint64_t{1} << i) - 1);
+        }
+      }
+      return max;
+    }
+  };
+
+  Histogram() = default;
+  Histogram(const Histogram&) = delete;
+  Histogram(Histogram&&) = delete;
+  auto operator=(const Histogram&) -> Histogram& = delete;
+  auto operator=(Histogram&&) -> Histogram& = delete;
+
+  void Record(uint64_t value) {
+    size_t bucket = 0;
+    for (auto v = value; v != 0 && bucket + 1 < kBuckets; v >>= 1) {
+      ++bucket;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    for (auto max = max_.load(std::memory_order_relaxed);
+         value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed);) {
+    }
+  }
+
+  [[nodiscard]] auto Take() const -> Snapshot {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count = count_.load(std::memory_order_relaxed);
+    snapshot.sum = sum_.load(std::memory_order_relaxed);
+    snapshot.max = max_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> sum_ = 0;
+  std::atomic<uint64_t> max_ = 0;
+};
+
+}  // namespace cab
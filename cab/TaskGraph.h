@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Executor.h"
+
+namespace cab {
+
+// Runs tasks on an Executor once all of their predecessors have succeeded.
+// A task reports failure by returning false; its descendants are then
+// cancelled while unrelated tasks keep running. Among ready tasks, those
+// with a higher priority start first.
+class TaskGraph {
+ public:
+  using Id = size_t;
+  using Function = std::function<bool(void)>;
+  // Asynchronous tasks get a callback instead of returning; they finish when
+  // it is invoked, from any thread, without holding a worker meanwhile.
+  using Done = std::function<void(bool)>;
+  using AsyncFunction = std::function<void(Done)>;
+
+  enum class State {
+    Pending,
+    Running,
+    Succeeded,
+    Failed,
+    Cancelled,
+  };
+
+ public:
+  explicit TaskGraph(Executor& executor)
+    : executor_(executor) {
+  }
+
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph(TaskGraph&&) = delete;
+  auto operator=(const TaskGraph&) -> TaskGraph& = delete;
+  auto operator=(TaskGraph&&) -> TaskGraph& = delete;
+
+  ~TaskGraph() {
+    CancelAll();
+    Wait();
+  }
+
+  // Predecessors must have been added before. Tasks added before Run() are
+  // held back so that the initial ready set is submitted as one batch.
+  auto Add(Function function, const std::vector<Id>& predecessors = {}, double priority = 0) -> Id {
+    return AddNode(std::move(function), nullptr, predecessors, priority);
+  }
+
+  // The Done callback must be invoked exactly once.
+  auto AddAsync(AsyncFunction function, const std::vector<Id>& predecessors = {}, double priority = 0) -> Id {
+    return AddNode(nullptr, std::move(function), predecessors, priority);
+  }
+
+  void Run() {
+    std::vector<Id> ready;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (running_) {
+        return;
+      }
+      running_ = true;
+      for (Id id = 0; id < nodes_.size(); ++id) {
+        const auto& node = *nodes_[id];
+        if (node.state == State::Pending && node.waiting == 0) {
+          ready.push_back(id);
+        }
+      }
+    }
+    Submit(ready);
+  }
+
+  // Blocks until every task added so far has finished, failed or been cancelled.
+  void Wait() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (!running_ && unfinished_ > 0) {
+      locker.unlock();
+      Run();
+      locker.lock();
+    }
+    finished_.wait(locker, [this] { return unfinished_ == 0 && inflight_ == 0; });
+  }
+
+  [[nodiscard]] auto Future(Id id) const -> std::shared_future<State> {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return nodes_.at(id)->future;
+  }
+
+  [[nodiscard]] auto StateOf(Id id) const -> State {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return nodes_.at(id)->state;
+  }
+
+  // Invoked with the final state, immediately if the task already finished.
+  void Then(Id id, std::function<void(State)> continuation) {
+    State state = State::Pending;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      auto& node = *nodes_.at(id);
+      if (!IsFinal(node.state)) {
+        node.continuations.push_back(std::move(continuation));
+        return;
+      }
+      state = node.state;
+    }
+    continuation(state);
+  }
+
+  // Cancels a pending task and all of its descendants.
+  void Cancel(Id id) {
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      CancelLocked(id);
+    }
+    Finish({});
+  }
+
+  void CancelAll() {
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      for (Id id = 0; id < nodes_.size(); ++id) {
+        CancelLocked(id);
+      }
+    }
+    Finish({});
+  }
+
+ private:
+  struct Node {
+    Function function;
+    AsyncFunction async;
+    double priority = 0;
+    State state = State::Pending;
+    size_t waiting = 0;
+    std::vector<Id> successors;
+    std::vector<std::function<void(State)>> continuations;
+    std::promise<State> promise;
+    std::shared_future<State> future;
+  };
+
+  auto AddNode(Function function, AsyncFunction async, const std::vector<Id>& predecessors, double priority) -> Id {
+    std::vector<Id> ready;
+    Id id = 0;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      id = nodes_.size();
+      nodes_.push_back(std::make_unique<Node>());
+      auto& node = *nodes_.back();
+      node.function = std::move(function);
+      node.async = std::move(async);
+      node.priority = priority;
+      node.future = node.promise.get_future().share();
+      ++unfinished_;
+      bool cancelled = false;
+      for (const auto predecessor : predecessors) {
+        auto& other = *nodes_.at(predecessor);
+        if (other.state == State::Failed || other.state == State::Cancelled) {
+          cancelled = true;
+        } else if (other.state != State::Succeeded) {
+          other.successors.push_back(id);
+          ++node.waiting;
+        }
+      }
+      if (cancelled) {
+        node.waiting = 0;
+        CancelLocked(id);
+      } else if (node.waiting == 0 && running_) {
+        ready.push_back(id);
+      }
+    }
+    Finish(ready);
+    return id;
+  }
+
+  static auto IsFinal(State state) -> bool {
+    return state == State::Succeeded || state == State::Failed || state == State::Cancelled;
+  }
+
+  auto Less() const {
+    return [this](Id a, Id b) {
+      const auto pa = nodes_[a]->priority;
+      const auto pb = nodes_[b]->priority;
+      return pa < pb || (pa == pb && a > b);
+    };
+  }
+
+  // Each executor job runs whichever ready task is most urgent by then.
+  void Submit(const std::vector<Id>& ids) {
+    if (ids.empty()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      inflight_ += ids.size();
+      for (const auto id : ids) {
+        ready_.push_back(id);
+        std::push_heap(ready_.begin(), ready_.end(), Less());
+      }
+    }
+    std::vector<Executor::Job> jobs(ids.size(), [this]() { ExecuteNext(); });
+    executor_.PushBatch(jobs);
+  }
+
+  void ExecuteNext() {
+    Id id = 0;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      std::pop_heap(ready_.begin(), ready_.end(), Less());
+      id = ready_.back();
+      ready_.pop_back();
+    }
+    RunTask(id);
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (--inflight_ == 0 && unfinished_ == 0) {
+      finished_.notify_all();
+    }
+  }
+
+  void RunTask(Id id) {
+    Function function;
+    AsyncFunction async;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      auto& node = *nodes_[id];
+      if (node.state != State::Pending) {
+        return;
+      }
+      node.state = State::Running;
+      function = std::move(node.function);
+      async = std::move(node.async);
+      if (async) {
+        ++inflight_;
+      }
+    }
+    if (!async) {
+      Complete(id, function());
+      return;
+    }
+    async([this, id](bool ok) {
+      Complete(id, ok);
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (--inflight_ == 0 && unfinished_ == 0) {
+        finished_.notify_all();
+      }
+    });
+  }
+
+  void Complete(Id id, bool ok) {
+    std::vector<Id> ready;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      auto& node = *nodes_[id];
+      if (ok) {
+        for (const auto successor : node.successors) {
+          auto& other = *nodes_[successor];
+          if (other.state == State::Pending && --other.waiting == 0) {
+            ready.push_back(successor);
+          }
+        }
+      } else {
+        for (const auto successor : node.successors) {
+          CancelLocked(successor);
+        }
+      }
+      CompleteLocked(id, ok ? State::Succeeded : State::Failed);
+    }
+    Finish(ready);
+  }
+
+  // Submits the ready tasks and fires continuations of finished ones.
+  void Finish(const std::vector<Id>& ids) {
+    std::vector<Id> ready;
+    std::vector<std::pair<std::vector<std::function<void(State)>>, State>> fired;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      for (const auto id : ids) {
+        auto& node = *nodes_[id];
+        if (node.state == State::Pending) {
+          ready.push_back(id);
+        }
+      }
+      for (auto& [id, state] : completed_) {
+        fired.emplace_back(std::move(nodes_[id]->continuations), state);
+      }
+      completed_.clear();
+    }
+    Submit(ready);
+    for (auto& [continuations, state] : fired) {
+      for (auto& continuation : continuations) {
+        continuation(state);
+      }
+    }
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (unfinished_ == 0 && inflight_ == 0) {
+      finished_.notify_all();
+    }
+  }
+
+  void CancelLocked(Id id) {
+    std::vector<Id> stack{id};
+    while (!stack.empty()) {
+      const auto current = stack.back();
+      stack.pop_back();
+      auto& node = *nodes_[current];
+      if (node.state != State::Pending) {
+        continue;
+      }
+      CompleteLocked(current, State::Cancelled);
+      node.function = nullptr;
+      node.async = nullptr;
+      stack.insert(stack.end(), node.successors.begin(), node.successors.end());
+    }
+  }
+
+  void CompleteLocked(Id id, State state) {
+    auto& node = *nodes_[id];
+    node.state = state;
+    node.promise.set_value(state);
+    completed_.emplace_back(id, state);
+    --unfinished_;
+  }
+
+ private:
+  Executor& executor_;
+  mutable std::mutex mutex_;
+  std::condition_variable finished_;
+  std::vector<std::unique_ptr<Node>> nodes_;
+  std::vector<std::pair<Id, State>> completed_;
+  std::vector<Id> ready_;
+  size_t unfinished_ = 0;
+  size_t inflight_ = 0;
+  bool running_ = false;
+};
+
+}  // namespace cab
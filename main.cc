@@ -1,28 +1,94 @@
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "cab/ArgumentParser.h"
 #include "cab/Executor.h"
-#include "cab/Semaphore.h"
+#include "cab/TaskGraph.h"
 
+#include "Build.h"
+#include "BuildLog.h"
+#include "Clean.h"
+#include "Impact.h"
+#include "JobTuner.h"
+#include "Jobserver.h"
+#include "Link.h"
+#include "Lto.h"
 #include "MakeParser.h"
+#include "Metrics.h"
+#include "Modules.h"
+#include "Ninja.h"
+#include "Pgo.h"
+#include "Project.h"
+#include "ProcessManager.h"
 #include "SourceAnalyzer.h"
+#include "TimeTrace.h"
+#include "Tests.h"
+#include "Toolchain.h"
 #include "Utils.h"
 
+static void PrintExecutorStats(const cab::Executor::Stats& stats) {
+  const auto print = [](const char* name, const cab::Histogram::Snapshot& histogram) {
+    std::cout
+      << "(I)   " << name << ": mean " << histogram.Mean() / 1000 << "ms"
+      << ", p50 <" << histogram.Percentile(0.5) / 1000.0 << "ms"
+      << ", p90 <" << histogram.Percentile(0.9) / 1000.0 << "ms"
+      << ", max " << histogram.max / 1000.0 << "ms" << std::endl;
+  };
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "(I) executor: " << stats.run.count << " job(s) on " << stats.workers.size() << " worker(s)" << std::endl;
+  print("queue wait", stats.wait);
+  print("run time", stats.run);
+  for (size_t i = 0; i < stats.workers.size(); ++i) {
+    const auto& worker = stats.workers[i];
+    const auto total = worker.busy + worker.idle;
+    const auto utilization = total > 0 ? worker.busy * 100 / total : 0;
+    std::cout
+      << "(I)   worker " << i << ": busy " << worker.busy << "s, idle " << worker.idle
+      << "s, " << utilization << "% utilized" << std::endl;
+  }
+}
+
+static void PrintResourceUsage(const BuildLog& log, size_t top) {
+  const auto& records = log.Records();
+  std::vector<std::pair<std::string, BuildRecord>> entries(records.begin(), records.end());
+  const auto print = [&](const char* title, auto key) {
+    std::sort(entries.begin(), entries.end(), [&](const auto& a, const auto& b) {
+      return key(a.second) > key(b.second);
+    });
+    std::cout << "(I) " << title << ":" << std::endl;
+    for (size_t i = 0; i < std::min(top, entries.size()); ++i) {
+      const auto& [output, record] = entries[i];
+      std::cout
+        << "(I)   " << std::fixed << std::setprecision(2)
+        << record.max_rss / 1024.0 << "MiB rss, "
+        << record.user + record.system << "s cpu, "
+        << record.wall << "s wall  " << output << std::endl;
+    }
+  };
+  if (!entries.empty()) {
+    print("peak memory", [](const BuildRecord& record) { return static_cast<double>(record.max_rss); });
+    print("cpu time", [](const BuildRecord& record) { return record.user + record.system; });
+  }
+}
+
 auto main(int argc, char* argv[]) -> int {
   auto result = MakeParser().Parse(argc - 1, argv + 1);
   auto& args = result.args;
   const auto verbose = args.at("verbose") == "1";
   const auto without_link = args.at("wol") == "1";
-  const auto target = std::filesystem::path(args.at("workdir")) / std::filesystem::path(args.at("target"));
-
   // show help
   if (args.at("help") == "1") {
     cab::ArgumentParser::FormatHelpOptions options{4, 4, "\n"};
@@ -34,6 +100,46 @@ auto main(int argc, char* argv[]) -> int {
       << std::endl;
     std::exit(EXIT_SUCCESS);
   }
+  if (!args.at("dwp").empty() && args.at("fission") != "1") {
+    std::cerr << "(E) dwp packages split debug info and needs fission" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  // cleaning and listing sources neither compile nor link
+  const auto compiling = args.at("clean") != "1" && args.at("gc") != "1" && args.at("ninja-sources") != "1";
+  const auto& pgo = SetupPgo(args, compiling);
+  if (!pgo.ok) {
+    std::cerr << "(E) " << pgo.error << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  if (compiling) {
+    const auto& lto = SetupThinLto(args);
+    if (!lto.ok) {
+      std::cerr << "(E) " << lto.error << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (verbose && !lto.description.empty()) {
+      std::cout << "(I) thinlto: " << lto.description << std::endl;
+    }
+  }
+
+  // resolve targets
+  const auto& manifest = args.at("project");
+  if (result.rests.empty()) {
+    result.rests.emplace_back(".");
+  }
+  auto project = manifest.empty() ? MakeSingleProject(args, result.rests) : LoadProject(manifest, args);
+  if (!project.ok) {
+    std::cerr << "(E) " << project.error << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  auto& targets = project.targets;
+  const auto target = std::filesystem::path(targets.back().output);
+  const auto& test_pattern = args.at("test");
+  const auto testing = !test_pattern.empty();
+  if (testing && targets.size() > 1) {
+    std::cerr << "(E) test mode builds a single target" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
 
   // ensure working directory
   {
@@ -60,140 +166,604 @@ auto main(int argc, char* argv[]) -> int {
         std::exit(EXIT_FAILURE);
       }
     }
+    for (const auto& target : targets) {
+      std::error_code err;
+      std::filesystem::create_directories(target.args.at("workdir"), err);
+    }
   }
 
+  cab::Executor executor;
+  BuildMetrics metrics;
+  metrics.target = manifest.empty() ? target.string() : manifest;
+  const auto finish = [&](bool ok) {
+    const auto& path = args.at("metrics");
+    metrics.ok = ok;
+    if (verbose) {
+      PrintExecutorStats(executor.Snapshot());
+    }
+    if (!path.empty() && !WriteMetrics(path, metrics, std::stoul(args.at("top")))) {
+      std::cerr << "(W) failed to write metrics: " << path << std::endl;
+    }
+    std::exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  };
+
   // gather source files
+  Stopwatch walk_watch;
   std::vector<std::string> source_paths;
-  if (result.rests.empty()) {
-    result.rests.emplace_back(".");
+  // index of the target each source belongs to
+  std::vector<size_t> owners;
+  std::vector<std::unique_ptr<SourceAnalyzer>> analyzers;
+  for (size_t t = 0; t < targets.size(); ++t) {
+    auto& analyzer = *analyzers.emplace_back(std::make_unique<SourceAnalyzer>(targets[t].args));
+    if (!pgo.stamp.empty()) {
+      analyzer.AddDependency(pgo.stamp);
+    }
+    std::vector<std::string> paths;
+    for (const auto& arg : targets[t].sources) {
+      if (std::filesystem::is_regular_file(arg)) {
+        paths.push_back(arg);
+      } else if (std::filesystem::is_directory(arg)) {
+        WalkDirectory(
+          arg,
+          [&](const std::filesystem::path& path) {
+            return path.filename().string()[0] != '.';
+          },
+          [&](const std::filesystem::path& path) {
+            if (path.has_extension() && std::filesystem::is_regular_file(path)) {
+              paths.push_back(path.string());
+            }
+          });
+      } else {
+        std::cerr << "(E) invalid option or path: " << arg << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+    }
+    paths.erase(
+      std::remove_if(paths.begin(), paths.end(), [&](const auto& path) {
+        return !analyzer.Accepts(path);
+      }),
+      paths.end());
+    SortStrings(paths);
+    if (paths.empty() && !manifest.empty()) {
+      std::cerr << "(E) no source files for " << targets[t].name << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    source_paths.insert(source_paths.end(), paths.begin(), paths.end());
+    owners.insert(owners.end(), paths.size(), t);
   }
-  for (const auto& arg : result.rests) {
-    if (std::filesystem::is_regular_file(arg)) {
-      source_paths.push_back(arg);
-    } else if (std::filesystem::is_directory(arg)) {
-      WalkDirectory(
-        arg,
-        [&](const std::filesystem::path& path) {
-          return path.filename().string()[0] != '.';
-        },
-        [&](const std::filesystem::path& path) {
-          if (path.has_extension() && std::filesystem::is_regular_file(path)) {
-            source_paths.push_back(path.string());
-          }
-        });
-    } else {
-      std::cerr << "(E) invalid option or path: " << arg << std::endl;
+  if (testing) {
+    const auto& shard = ParseTestShard(args.at("shard"));
+    if (!shard) {
+      std::cerr << "(E) invalid shard, expect i/n with i < n: " << args.at("shard") << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    size_t nth = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < source_paths.size(); ++i) {
+      if (!IsTestSource(source_paths[i], test_pattern) || shard->Contains(nth++)) {
+        std::swap(source_paths[kept], source_paths[i]);
+        std::swap(owners[kept++], owners[i]);
+      }
+    }
+    source_paths.resize(kept);
+    owners.resize(kept);
+  }
+  metrics.walk = walk_watch.Elapsed();
+  metrics.discovered = source_paths.size();
+  // an exported build.ninja runs this before every build to notice new sources
+  if (args.at("ninja-sources") == "1") {
+    if (args.at("ninja").empty() || !WriteNinjaSources(args.at("ninja"), source_paths)) {
+      std::cerr << "(E) failed to write the source list of " << args.at("ninja") << std::endl;
       std::exit(EXIT_FAILURE);
     }
+    std::exit(EXIT_SUCCESS);
   }
-  SortStrings(source_paths);
-  if (source_paths.empty()) {
+  const auto clean = args.at("clean") == "1";
+  const auto gc = args.at("gc") == "1";
+  if (source_paths.empty() && !clean && !gc) {
     std::cout << "(W) no souce files" << std::endl;
     std::exit(EXIT_SUCCESS);
   }
 
-  cab::Executor executor;
-  executor.Start(std::stoul(args.at("jobs")));
+  // jobs=auto tunes how many compiles run at once up to one per core,
+  // starting where the last build on this host ended up
+  const auto auto_jobs = args.at("jobs") == "auto";
+  auto jobs = auto_jobs ? 0 : std::stoul(args.at("jobs"));
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  metrics.jobs = jobs;
+  const auto& tuned_path = (std::filesystem::path(args.at("workdir")) / ".sb_jobs").string();
+  std::optional<JobTuner> tuner;
+  if (auto_jobs) {
+    const auto saved = LoadTunedJobs(tuned_path);
+    tuner.emplace(saved.value_or(jobs), jobs);
+    if (verbose) {
+      std::cout << "(I) jobs=auto: starting at " << tuner->Limit() << " of " << jobs << " job(s)"
+                << (saved ? ", the best of the last build" : ", one per core") << std::endl;
+    }
+  }
+  Jobserver jobserver;
+  if (args.at("jobserver") == "1") {
+    if (!jobserver.Setup(jobs)) {
+      std::cerr << "(W) failed to set up jobserver" << std::endl;
+    } else if (verbose) {
+      std::cout << "(I) " << jobserver.Description() << std::endl;
+    }
+  }
+
+  if (verbose) {
+    executor.EnableStats();
+  }
+  // workers only analyze and bookkeep, children are waited for by the reactor
+  executor.Start(std::min<size_t>(jobs, std::max(1u, std::thread::hardware_concurrency())));
+  // jobs=auto measures compiles only, links and tests keep every job
+  ProcessManager processes(executor, jobserver, jobs);
+  if (tuner) {
+    processes.Throttle(tuner->Limit());
+  }
+
+  BuildLog log((std::filesystem::path(args.at("workdir")) / ".sb_log").string());
+  log.Load();
+
+  // clean recorded and derivable outputs, or only those no source owns any more
+  if (gc && manifest.empty()) {
+    for (const auto& source : targets.front().sources) {
+      if (std::filesystem::is_regular_file(source)) {
+        std::cerr << "(E) gc needs every source of the build, name directories instead of " << source << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+    }
+  }
+  if (clean || gc) {
+    const auto& candidates = CleanCandidates(args, project, analyzers, source_paths, owners, log, gc);
+    if (gc && !log.Save()) {
+      std::cerr << "(W) failed to save build log" << std::endl;
+    }
+    const auto removed = RemoveFiles(executor, candidates, jobs, verbose);
+    std::cout << "Removed " << removed << " file(s)" << std::endl;
+    std::exit(EXIT_SUCCESS);
+  }
+  const auto& impact = args.at("impact");
+  ImpactIndex impact_index(log, jobs);
+
+  const auto profile_headers = args.at("profile-headers") == "1";
+  if (profile_headers && (ProbeCompilerKind(args.at("cc")) != CompilerKind::Clang || ProbeCompilerKind(args.at("cxx")) != CompilerKind::Clang)) {
+    std::cerr << "(E) profile-headers requires clang for -ftime-trace" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  const auto rsp_threshold = std::stoul(args.at("rsp"));
+  const auto cutoff = args.at("cutoff") == "1";
+  const auto modules = args.at("modules") == "1";
+  const auto cxx_kind = modules ? ProbeCompilerKind(args.at("cxx")) : CompilerKind::Unknown;
 
   // analyze source files
-  std::vector<SourceFile> new_files;
-  std::vector<std::string> all_outputs;
-  auto linker = Linker::ForLd(args.at("ld"));
+  Stopwatch build_watch;
+  std::vector<SourceFile> files(source_paths.size());
+  std::vector<Linker> linkers;
+  for (const auto& target : targets) {
+    linkers.push_back(Linker::ForLd(target.args.at("ld")));
+  }
+  std::vector<size_t> target_stale(targets.size(), 0);
+
+  FastLinkers fast_linkers(args, jobs, verbose);
+
+  // estimate the longest path from each task to the end of the build with
+  // recorded times, so that work on it starts first
+  const auto estimate = [&](const std::string& output, double fallback) {
+    const auto& record = log.Find(output);
+    return record ? record->wall : fallback;
+  };
+  double known = 0;
+  size_t count = 0;
+  for (const auto& [output, record] : log.Records()) {
+    known += record.wall;
+    ++count;
+  }
+  const auto fallback = count > 0 ? known / count : 1.0;
+  std::vector<double> tails(targets.size(), 0);
   {
-    std::mutex mutex;
-    cab::Semaphore semaphore;
-    SourceAnalyzer analyzer(args);
-    for (size_t i = 0; i < source_paths.size(); ++i) {
-      executor.Push([&, i = i]() {
-        auto file = analyzer.Process(source_paths[i]);
-        if (file) {
-          std::lock_guard<std::mutex> locker(mutex);
-          all_outputs.push_back(file.output);
-          if (file.linker > linker) {
-            linker = file.linker;
-          }
-          if (!file.command.empty()) {
-            new_files.push_back(std::move(file));
+    std::vector<double> dependents(targets.size(), 0);
+    for (size_t t = targets.size(); t-- > 0;) {
+      tails[t] = estimate(targets[t].output, fallback) + dependents[t];
+      for (const auto dependency : targets[t].dependencies) {
+        dependents[dependency] = std::max(dependents[dependency], tails[t]);
+      }
+    }
+  }
+  std::vector<double> priorities(source_paths.size());
+  for (size_t i = 0; i < source_paths.size(); ++i) {
+    const auto output = analyzers[owners[i]]->Artifacts(source_paths[i]).front();
+    priorities[i] = estimate(output, fallback) + tails[owners[i]];
+  }
+
+  cab::TaskGraph graph(executor);
+  BuildContext build(args, project, graph, processes, log, metrics, build_watch, files, owners, linkers, verbose);
+
+  // scan sources sharing compiler and flags with one -MM process per chunk,
+  // with about one chunk per job and each command line below rsp=
+  std::map<std::pair<size_t, std::string>, std::vector<size_t>> scan_groups;
+  for (size_t i = 0; i < source_paths.size(); ++i) {
+    const auto& group = analyzers[owners[i]]->ScanGroup(source_paths[i]);
+    if (!group.empty()) {
+      scan_groups[{owners[i], group}].push_back(i);
+    }
+  }
+  std::vector<std::vector<cab::TaskGraph::Id>> scan_predecessors(source_paths.size());
+  size_t chunks = 0;
+  for (const auto& [key, members] : scan_groups) {
+    const auto per_chunk = (members.size() + jobs - 1) / jobs;
+    for (size_t begin = 0; begin < members.size();) {
+      auto length = key.second.size();
+      auto end = begin;
+      while (end < members.size() && end - begin < per_chunk &&
+             (end == begin || length + source_paths[members[end]].size() < rsp_threshold)) {
+        length += source_paths[members[end]].size() + 1;
+        ++end;
+      }
+      if (end - begin > 1) {
+        std::vector<size_t> chunk(members.begin() + begin, members.begin() + end);
+        double priority = 0;
+        for (const auto i : chunk) {
+          priority = std::max(priority, priorities[i]);
+        }
+        const auto id = graph.Add([&, chunk, owner = key.first]() {
+          std::vector<std::string> paths;
+          for (const auto i : chunk) {
+            paths.push_back(source_paths[i]);
           }
+          analyzers[owner]->Prescan(paths);
+          return true;
+        }, {}, priority);
+        for (const auto i : chunk) {
+          scan_predecessors[i].push_back(id);
         }
-        semaphore.Post();
-      });
+        ++chunks;
+      }
+      begin = end;
     }
-    semaphore.Wait(source_paths.size());
   }
-  SortStrings(all_outputs);
-  if (linker) {
-    args.at("ld") = linker.command;
+  if (verbose && chunks > 0) {
+    std::cout << "(I) scanning dependencies in " << chunks << " batch(es)" << std::endl;
   }
 
-  // clean object and and target files
-  if (args.at("clean") == "1") {
-    const auto& objects = JoinStrings(all_outputs);
-    const auto& command = "rm -f " + target.string() + ' ' + objects;
-    std::cout << command << std::endl;
-    std::system(command.c_str());
-    std::exit(EXIT_SUCCESS);
+  // progress counts every compile and link until analysis rules them out
+  build.total = source_paths.size() + (without_link || testing ? 0 : targets.size());
+  std::vector<cab::TaskGraph::Id> analyze_tasks;
+  for (size_t i = 0; i < source_paths.size(); ++i) {
+    analyze_tasks.push_back(graph.Add([&, i = i]() {
+      auto file = analyzers[owners[i]]->Process(source_paths[i]);
+      std::lock_guard<std::mutex> locker(build.mutex);
+      if (file) {
+        ++metrics.analyzed;
+        if (!file.command.empty()) {
+          ++metrics.stale;
+          ++target_stale[owners[i]];
+        }
+        if (!impact.empty()) {
+          impact_index.Add(file);
+        }
+        if (file.linker > linkers[owners[i]]) {
+          linkers[owners[i]] = file.linker;
+        }
+      }
+      if (file.command.empty()) {
+        --build.total;
+      }
+      files[i] = std::move(file);
+      metrics.analyze = build_watch.Elapsed();
+      return true;
+    }, scan_predecessors[i], priorities[i]));
   }
 
-  // compile source files
-  if (!new_files.empty()) {
-    const auto get_sources = [&]() {
-      std::vector<std::string> sources(new_files.size());
-      std::transform(new_files.begin(), new_files.end(), sources.begin(), [](const auto& item) {
-        return item.source;
-      });
-      return JoinStrings(sources);
+  // report rebuild impact
+  if (!impact.empty()) {
+    graph.Wait();
+    const auto print = [&](const ImpactReport& report) {
+      std::cout
+        << "  ~" << std::fixed << std::setprecision(2) << report.wall << "s wall, "
+        << report.cpu << "s cpu, " << report.outputs.size() << " object(s)";
+      if (report.unknown > 0) {
+        std::cout << ", " << report.unknown << " without timing";
+      }
+      std::cout << "  " << report.path << std::endl;
     };
-    const auto& text = verbose ? get_sources() : (std::to_string(new_files.size()) + " file(s)");
-    std::cout << "Build " << text << std::endl;
-    {
-      const size_t total = new_files.size() + (without_link ? 0 : 1);
-      size_t current = 0;
-      std::atomic_size_t failed = 0;
-      std::mutex mutex;
-      cab::Semaphore semaphore;
-      for (size_t i = 0; i < new_files.size(); ++i) {
-        executor.Push([&, i = i]() {
-          if (failed == 0) {
-            const auto& file = new_files[i];
-            const auto& text = verbose ? file.command : (file.source + " => " + file.output);
-            {
-              std::lock_guard<std::mutex> locker(mutex);
-              const auto percentage = ++current * 100 / total;
-              std::cout << "[ " << std::setfill(' ') << std::setw(3) << percentage << "% ] " << text << std::endl;
-            }
-            const auto ok = std::system(file.command.c_str()) == 0;
-            if (!ok) {
-              ++failed;
-            }
-          }
-          semaphore.Post();
-        });
+    if (impact == "*") {
+      const auto& reports = impact_index.Rank(std::stoul(args.at("top")));
+      std::cout << "Top " << reports.size() << " header(s) by rebuild cost with " << jobs << " job(s):" << std::endl;
+      for (const auto& report : reports) {
+        print(report);
       }
-      semaphore.Wait(new_files.size());
-      if (failed > 0) {
+    } else {
+      const auto& report = impact_index.Query(impact);
+      std::cout << "Touching " << report.path << " rebuilds with " << jobs << " job(s):" << std::endl;
+      print(report);
+      for (size_t i = 0; i < report.outputs.size(); ++i) {
+        std::cout << "    ";
+        if (report.costs[i] < 0) {
+          std::cout << "    ?";
+        } else {
+          std::cout << std::setw(5) << report.costs[i];
+        }
+        std::cout << "s  " << report.outputs[i] << std::endl;
+      }
+    }
+    std::exit(EXIT_SUCCESS);
+  }
+
+  // compile each source once its own analysis is done
+  double compile_start = -1;
+  std::atomic_size_t failed = 0;
+  std::vector<size_t> order(source_paths.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<std::vector<size_t>> providers(source_paths.size());
+
+  // module interfaces must be compiled before their importers
+  if (modules) {
+    graph.Wait();
+    auto plan = PlanModules(files);
+    if (!plan.ok) {
+      std::cerr << "(E) " << plan.error << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (verbose) {
+      for (const auto& name : plan.external) {
+        std::cout << "(I) module not built here: " << name << std::endl;
+      }
+    }
+    // interfaces are cached in the workdir of the target providing them
+    std::map<std::string, std::string> interfaces;
+    for (size_t i = 0; i < files.size(); ++i) {
+      if (!files[i].module.empty()) {
+        interfaces[files[i].module] = ModuleInterfacePath(cxx_kind, targets[owners[i]].args.at("workdir"), files[i].module);
+      }
+    }
+    for (const auto& target : targets) {
+      if (cxx_kind == CompilerKind::Gcc && !WriteModuleMapper(target.args.at("workdir"), interfaces)) {
+        std::cerr << "(E) failed to write module mapper" << std::endl;
         std::exit(EXIT_FAILURE);
       }
     }
+    for (size_t i = 0; i < files.size(); ++i) {
+      for (const auto provider : plan.providers[i]) {
+        if (owners[provider] == owners[i]) {
+          continue;
+        }
+        const auto& name = files[provider].module;
+        const auto& flag = ImportedModuleFlag(cxx_kind, name, interfaces.at(name));
+        files[i].rebuild = JoinStrings({files[i].rebuild, flag});
+        if (!files[i].command.empty()) {
+          files[i].command = JoinStrings({files[i].command, flag});
+        }
+      }
+    }
+    for (const auto i : plan.order) {
+      auto& file = files[i];
+      const auto stale = std::any_of(plan.providers[i].begin(), plan.providers[i].end(), [&](auto provider) {
+        return !files[provider].command.empty();
+      });
+      if (stale && file.command.empty()) {
+        file.command = file.rebuild;
+        ++metrics.stale;
+        ++target_stale[owners[i]];
+        ++build.total;
+      }
+    }
+    // interfaces also lead to whatever their importers lead to
+    for (auto iter = plan.order.rbegin(); iter != plan.order.rend(); ++iter) {
+      for (const auto provider : plan.providers[*iter]) {
+        const auto output = analyzers[owners[provider]]->Artifacts(source_paths[provider]).front();
+        priorities[provider] = std::max(priorities[provider], estimate(output, fallback) + priorities[*iter]);
+      }
+    }
+    order = std::move(plan.order);
+    providers = std::move(plan.providers);
   }
 
-  // link object files
-  if (!without_link && (!new_files.empty() || !std::filesystem::exists(target))) {
-    const auto& objects = JoinStrings(all_outputs);
-    const auto& linker = args.at("ld");
-    if (linker.empty()) {
-      std::cerr << "(E) undetermined linker" << std::endl;
+  // hand the analyzed build over to ninja instead of running it
+  const auto& ninja_path = args.at("ninja");
+  if (!ninja_path.empty()) {
+    if (testing) {
+      std::cerr << "(E) ninja export does not cover test mode" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    graph.Wait();
+    auto ninja = DescribeBuild(build, fast_linkers, providers, pgo.stamp, without_link);
+    if (!ninja.ok) {
+      std::cerr << "(E) " << ninja.error << std::endl;
       std::exit(EXIT_FAILURE);
     }
-    const auto& command =
-      JoinStrings({linker, args.at("ldflags"), "-o", target.string(), objects});
-    const auto& text = verbose ? command : target.string();
-    std::cout << "[ 100% ] " << text << std::endl;
-    if (std::system(command.c_str()) != 0) {
-      std::cerr << "(E) failed to link" << std::endl;
+    ninja.jobs = jobs;
+    std::vector<std::string> command;
+    for (int k = 0; k < argc; ++k) {
+      command.push_back(ShellQuote(argv[k]));
+    }
+    ninja.regenerate = JoinStrings(command);
+    ninja.list_sources = JoinStrings({ninja.regenerate, "ninja-sources"});
+    if (!manifest.empty()) {
+      ninja.watched.push_back(manifest);
+    }
+    if (!WriteNinjaSources(ninja_path, source_paths)) {
+      std::cerr << "(E) failed to write the source list of " << ninja_path << std::endl;
       std::exit(EXIT_FAILURE);
     }
+    if (!WriteNinja(ninja_path, ninja)) {
+      std::cerr << "(E) failed to write " << ninja_path << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    std::cout << "Wrote " << ninja_path << " with " << ninja.compiles.size() << " compile(s) and " << ninja.links.size() << " link(s)" << std::endl;
+    std::exit(EXIT_SUCCESS);
+  }
+
+  // announce the build once every source is analyzed, without holding up
+  // compiles, and count the links that will run
+  LinkStage links(build, fast_linkers, target_stale);
+  const auto announce = graph.Add([&]() {
+    std::vector<std::string> sources;
+    for (const auto& file : files) {
+      if (!file.command.empty()) {
+        sources.push_back(file.source);
+      }
+    }
+    std::lock_guard<std::mutex> locker(build.mutex);
+    if (!without_link && !testing) {
+      links.Count();
+    }
+    if (!sources.empty()) {
+      const auto& text = verbose ? JoinStrings(sources) : (std::to_string(sources.size()) + " file(s)");
+      std::cout << "Build " << text << std::endl;
+    }
+    return true;
+  }, analyze_tasks, std::numeric_limits<double>::max());
+
+  std::vector<cab::TaskGraph::Id> compile_ids(source_paths.size());
+  for (const auto i : order) {
+    std::vector<cab::TaskGraph::Id> predecessors{analyze_tasks[i]};
+    for (const auto provider : providers[i]) {
+      predecessors.push_back(compile_ids[provider]);
+    }
+    compile_ids[i] = graph.AddAsync([&, i = i](cab::TaskGraph::Done done) {
+      const auto& file = files[i];
+      if (file.command.empty()) {
+        done(true);
+        return;
+      }
+      if (failed > 0) {
+        done(false);
+        return;
+      }
+      const auto previous = log.Find(file.output);
+      const auto compile = [&, i, previous, done](uint64_t input) {
+        const auto& file = files[i];
+        build.Progress(verbose ? file.command : (file.source + " => " + file.output));
+        const auto start = build_watch.Elapsed();
+        processes.Spawn(file.command, [&, i, previous, input, start, done](const ProcessResult& process) {
+          const auto& file = files[i];
+          const auto ok = static_cast<bool>(process);
+          if (ok) {
+            const auto content = cutoff ? HashFile(file.output).value_or(0) : 0;
+            log.Update(file.output, {process.wall, process.user, process.system, process.max_rss, input, content, file.byproducts});
+          } else {
+            ++failed;
+          }
+          {
+            std::lock_guard<std::mutex> locker(build.mutex);
+            if (compile_start < 0 || start < compile_start) {
+              compile_start = start;
+            }
+            metrics.compile = build_watch.Elapsed() - compile_start;
+            if (ok) {
+              ++metrics.compiled;
+              metrics.units.emplace_back(file.source, process.wall);
+            }
+            if (ok && tuner && tuner->Record(build_watch.Elapsed(), previous ? previous->wall : fallback)) {
+              processes.Throttle(tuner->Limit());
+              if (verbose) {
+                std::cout << "(I) jobs=auto: " << tuner->Reason() << std::endl;
+              }
+            }
+          }
+          done(ok);
+        }, 0, priorities[i], true);
+      };
+      if (file.preprocess.empty()) {
+        compile(0);
+        return;
+      }
+      const auto& preprocessed = file.output + ".ii";
+      processes.Spawn(file.preprocess + " > " + preprocessed + " 2>/dev/null", [&, i, previous, compile, done, preprocessed](const ProcessResult& process) {
+        const auto& file = files[i];
+        const auto input = process ? HashFile(preprocessed, file.cutoff_seed).value_or(0) : 0;
+        std::error_code err;
+        std::filesystem::remove(preprocessed, err);
+        const auto unchanged =
+          input != 0 && previous && previous->input == input && std::filesystem::exists(file.output) &&
+          std::all_of(file.byproducts.begin(), file.byproducts.end(), [](const auto& path) {
+            return std::filesystem::exists(path);
+          });
+        if (!unchanged) {
+          compile(input);
+          return;
+        }
+        Touch(file.output);
+        for (const auto& byproduct : file.byproducts) {
+          Touch(byproduct);
+        }
+        {
+          std::lock_guard<std::mutex> locker(build.mutex);
+          --build.total;
+          ++metrics.cutoff;
+          if (verbose) {
+            std::cout << "(I) unchanged after preprocessing: " << file.source << std::endl;
+          }
+        }
+        done(true);
+      }, 0, priorities[i], true);
+    }, predecessors, priorities[i]);
+  }
+
+  // link each target once its objects and the targets it links against are done
+  if (!without_link && !testing) {
+    std::vector<std::vector<cab::TaskGraph::Id>> link_predecessors(targets.size(), {announce});
+    for (size_t i = 0; i < source_paths.size(); ++i) {
+      link_predecessors[owners[i]].push_back(compile_ids[i]);
+    }
+    links.Add(std::move(link_predecessors), tails);
+  }
+
+  // link every test against an archive of the other objects, then run them
+  TestStage tests(build, fast_linkers);
+  if (testing && !tests.Add(source_paths, compile_ids, analyze_tasks)) {
+    std::cout << "(W) no test sources match " << test_pattern << std::endl;
+    std::exit(EXIT_SUCCESS);
+  }
+
+  graph.Run();
+  graph.Wait();
+  metrics.failed = failed;
+  metrics.max_concurrency = processes.MaxRunning();
+  if (tuner) {
+    metrics.jobs = tuner->Best();
+  }
+  if (tuner && tuner->Measured() && failed == 0) {
+    if (!SaveTunedJobs(tuned_path, tuner->Best())) {
+      std::cerr << "(W) failed to save " << tuned_path << std::endl;
+    } else if (verbose) {
+      std::cout << "(I) jobs=auto: next build starts at " << tuner->Best() << " job(s)" << std::endl;
+    }
+  } else if (tuner && verbose) {
+    std::cout << "(I) jobs=auto: too few compiles to measure, keeping " << tuned_path << std::endl;
+  }
+  if ((metrics.stale > 0 || links.Changed()) && !log.Save()) {
+    std::cerr << "(W) failed to save build log" << std::endl;
+  }
+  if (verbose) {
+    PrintResourceUsage(log, std::stoul(args.at("top")));
+  }
+  if (failed > 0 || links.Failed()) {
+    finish(false);
+  }
+  if (testing) {
+    finish(PrintTestSummary(std::cout, tests.Results()));
+  }
+
+  // aggregate time traces
+  if (profile_headers) {
+    TimeTraceProfile profile;
+    for (const auto& file : files) {
+      for (const auto& byproduct : file.byproducts) {
+        if (std::filesystem::path(byproduct).extension() == ".json" && !profile.Add(file.source, byproduct)) {
+          std::cerr << "(W) invalid time trace: " << byproduct << std::endl;
+        }
+      }
+    }
+    const auto top = std::stoul(args.at("top"));
+    const auto& report = (std::filesystem::path(args.at("workdir")) / "time-trace.json").string();
+    profile.Print(std::cout, top);
+    if (!profile.WriteJson(report, top)) {
+      std::cerr << "(W) failed to write " << report << std::endl;
+    }
   }
 
-  std::exit(EXIT_SUCCESS);
+  finish(true);
 }